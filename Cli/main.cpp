@@ -0,0 +1,313 @@
+#include "precompiled.h"
+
+#include <iostream>
+
+#include "rdf/RandomDecisionForest.h"
+#include "rdf/PackedDataSet.h"
+#include "rdf/ShardedRecognition.h"
+#include "tracking/particlefilter/ParticleFilter.h"
+#include "tracking/particlefilter/Target.h"
+#include "tracking/particlefilter/Particle.h"
+#include "tracking/dataExtraction/HOGExtactor.h"
+#include "PreprocessChain.h"
+
+// Headless driver : no QApplication, no windows, no event loop. Options come
+// from the command line or from the [General] keys of an ini file given with
+// --config, the command line wins.
+
+static bool s_verbose = false;
+
+// qDebug output is dropped unless --verbose, warnings and errors always pass.
+// Configuring with CPV_NO_DEBUG_OUTPUT compiles the core library's qDebug
+// calls out altogether, so hot loops do not even format them
+static void messageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg)
+{
+    if (type == QtDebugMsg && !s_verbose)
+        return;
+    std::cerr << msg.toLocal8Bit().constData() << std::endl;
+}
+
+class Options
+{
+  public:
+    Options(const QCommandLineParser &parser) : m_parser(parser)
+    {
+        if (parser.isSet("config"))
+            m_settings.reset(new QSettings(parser.value("config"), QSettings::IniFormat));
+    }
+
+    QString value(const QString &name, const QString &defaultValue = QString()) const
+    {
+        if (m_parser.isSet(name))
+            return m_parser.value(name);
+        if (m_settings)
+            return m_settings->value(name, defaultValue).toString();
+        return defaultValue;
+    }
+
+    int intValue(const QString &name, int defaultValue) const
+    {
+        return value(name, QString::number(defaultValue)).toInt();
+    }
+
+    // prints which option is missing
+    bool require(const QStringList &names) const
+    {
+        bool ok = true;
+        for (const QString &name : names)
+        {
+            if (value(name).isEmpty())
+            {
+                std::cerr << "missing --" << name.toStdString() << std::endl;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+  private:
+    const QCommandLineParser &m_parser;
+    std::unique_ptr<QSettings> m_settings;
+};
+
+// forest parameters, the dialog's defaults unless given
+static RDFParams forestParams(const Options &opt)
+{
+    RDFParams params;
+    params.trainImagesDir = opt.value("train-dir");
+    params.testDir = opt.value("test-dir");
+    params.probDistX = opt.intValue("prob-x", 30);
+    params.probDistY = opt.intValue("prob-y", 30);
+    params.nTrees = opt.intValue("trees", 12);
+    params.maxDepth = opt.intValue("depth", 20);
+    params.pixelsPerImage = opt.intValue("pixels", 300);
+    params.minLeafPixels = opt.intValue("min-leaf", 5);
+    params.labelCount = opt.intValue("labels", 26);
+    params.maxIteration = opt.intValue("iterations", 1);
+    params.imageCacheBytes = opt.value("cache-bytes", "0").toLongLong();
+    return params;
+}
+
+static bool loadForest(RandomDecisionForest &forest, const Options &opt)
+{
+    QString forestFile = opt.value("forest");
+    if (!QFile::exists(forestFile))
+    {
+        std::cerr << "forest file " << forestFile.toStdString() << " does not exist" << std::endl;
+        return false;
+    }
+    forest.loadForest(forestFile);
+    // not part of the saved forest
+    forest.params().testDir = opt.value("test-dir");
+    forest.params().imageCacheBytes = opt.value("cache-bytes", "0").toLongLong();
+    return true;
+}
+
+static int train(const Options &opt)
+{
+    if (!opt.require(QStringList() << "train-dir" << "forest"))
+        return 2;
+    RandomDecisionForest forest;
+    forest.setParams(forestParams(opt));
+    forest.readTrainingImageFiles();
+    forest.trainForest();
+    forest.saveForest(opt.value("forest"));
+    return 0;
+}
+
+static int test(const Options &opt)
+{
+    if (!opt.require(QStringList() << "test-dir" << "forest"))
+        return 2;
+    RandomDecisionForest forest;
+    if (!loadForest(forest, opt))
+        return 1;
+    // "index label word confidence" per image, in completion order
+    QObject::connect(&forest, &RandomDecisionForest::classifiedTestImage,
+                     [&forest](int index, QString word, float conf)
+    {
+        const std::vector<QString> &labels = forest.m_DS.m_testlabels;
+        QString label = index < (int)labels.size() ? labels[index] : QString("-");
+        std::cout << index << " " << label.toStdString() << " " << word.toStdString()
+                  << " " << conf << "\n";
+    });
+    forest.testStreaming(opt.intValue("prefetch", 4));
+    std::cout.flush();
+    return 0;
+}
+
+static int recognize(const Options &opt)
+{
+    if (!opt.require(QStringList() << "test-dir" << "forest"))
+        return 2;
+    QString output = opt.value("output", "./formatted_output.txt");
+    int nShards = opt.intValue("shards", 1);
+    if (nShards > 1)
+    {
+        ShardParams params;
+        params.m_forestFile = QFileInfo(opt.value("forest")).absoluteFilePath();
+        params.m_testDir = QFileInfo(opt.value("test-dir")).absoluteFilePath();
+        params.m_offsetsFile = QFileInfo(opt.value("offsets", "./combined.txt")).absoluteFilePath();
+        params.m_workDir = QFileInfo(opt.value("work-dir", "./shards")).absoluteFilePath();
+        params.m_nShards = nShards;
+        params.m_nParallel = opt.intValue("parallel", 0);
+        params.m_verbose = s_verbose;
+        QString index = QFileInfo(output).path() + "/" + QFileInfo(output).completeBaseName() + ".idx";
+        return ShardedRecognition::run(params, output, index) ? 0 : 1;
+    }
+    RandomDecisionForest forest;
+    if (!loadForest(forest, opt))
+        return 1;
+    RecognitionShard shard;
+    shard.m_offsetsFile = opt.value("offsets", shard.m_offsetsFile);
+    shard.m_outputFile = output;
+    shard.m_firstLine = opt.intValue("first", 0);
+    shard.m_lineCount = opt.intValue("count", -1);
+    forest.readAndIdentifyWords(shard);
+    return QFile::exists(output) ? 0 : 1;
+}
+
+static int search(const Options &opt)
+{
+    RandomDecisionForest forest;
+    if (!opt.value("queries").isEmpty())
+    {
+        forest.searchQueries(opt.value("queries"), opt.intValue("threads", 0));
+        return 0;
+    }
+    if (!opt.require(QStringList() << "query"))
+        return 2;
+    int queryId = opt.intValue("query-id", 1);
+    if (!opt.value("fuzzy").isEmpty())
+        forest.searchWordsFuzzy(opt.value("query"), queryId, opt.intValue("fuzzy", 1));
+    else
+        forest.searchWords(opt.value("query"), queryId);
+    return 0;
+}
+
+static int preprocess(const Options &opt)
+{
+    if (!opt.require(QStringList() << "src" << "dst" << "chain"))
+        return 2;
+    PreprocessChain chain;
+    if (!PreprocessChain::parse(opt.value("chain"), chain))
+    {
+        std::cerr << "invalid chain " << opt.value("chain").toStdString() << std::endl;
+        return 2;
+    }
+    int written = chain.run(opt.value("src"), opt.value("dst"), opt.intValue("threads", 0));
+    std::cout << written << " images written" << std::endl;
+    return 0;
+}
+
+static int pack(const Options &opt)
+{
+    if (!opt.require(QStringList() << "src" << "output"))
+        return 2;
+    return PackedDataSet::build(opt.value("src"), opt.value("output"), opt.intValue("prob-x", 30),
+                                opt.intValue("prob-y", 30), opt.intValue("threads", 0)) ? 0 : 1;
+}
+
+static int hog(const Options &opt)
+{
+    if (!opt.require(QStringList() << "src" << "output"))
+        return 2;
+    HOGExtactor extractor(opt.value("src"), opt.value("output"));
+    std::cout << extractor.getDataSize() << " descriptors written" << std::endl;
+    return 0;
+}
+
+// particle filter over every frame of a video, the best particle of each
+// frame is printed and the annotated frames optionally written out
+static int track(const Options &opt)
+{
+    if (!opt.require(QStringList() << "video" << "target"))
+        return 2;
+    cv::VideoCapture capture(opt.value("video").toStdString());
+    if (!capture.isOpened())
+    {
+        std::cerr << "can not open " << opt.value("video").toStdString() << std::endl;
+        return 1;
+    }
+    QImage targetImage(opt.value("target"));
+    if (targetImage.isNull())
+    {
+        std::cerr << "can not open " << opt.value("target").toStdString() << std::endl;
+        return 1;
+    }
+    int histSize = opt.intValue("hist", 16);
+    Target target(QFileInfo(opt.value("target")).baseName(),
+                  targetImage.convertToFormat(QImage::Format_RGB32), histSize);
+    int width = capture.get(CV_CAP_PROP_FRAME_WIDTH);
+    int height = capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+    ParticleFilter pf(width, height, opt.intValue("particles", 100), opt.intValue("iters", 1),
+                      target.getWidth(), target.getHeight(), histSize, &target);
+    cv::VideoWriter writer;
+    if (!opt.value("output").isEmpty())
+        writer.open(opt.value("output").toStdString(), CV_FOURCC('M', 'J', 'P', 'G'),
+                    capture.get(CV_CAP_PROP_FPS), cv::Size(width, height));
+    cv::Mat frame;
+    int frameNo = 0;
+    while (capture.read(frame))
+    {
+        pf.setIMG(&frame);
+        pf.processImage();
+        const Particle *best = pf.getParticles()[0];
+        std::cout << frameNo++ << " " << best->x() << " " << best->y() << "\n";
+        if (writer.isOpened())
+            writer.write(pf.getIMG());
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ImageCLEF");
+    qInstallMessageHandler(messageHandler);
+    // sharded recognition starts its workers from this same binary, with a
+    // trailing --verbose when the coordinator was given one
+    if (argc > 1 && QString(argv[1]) == "--recognize-shard")
+    {
+        s_verbose = app.arguments().contains("--verbose");
+        return ShardedRecognition::runShard(app.arguments().mid(2));
+    }
+    QCommandLineParser parser;
+    parser.setApplicationDescription("ImageCLEF batch driver");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "train | test | recognize | search | preprocess | pack | hog | track");
+    const QStringList valueOptions = QStringList()
+                                     << "config" << "train-dir" << "test-dir" << "forest" << "output"
+                                     << "prob-x" << "prob-y" << "trees" << "depth" << "pixels"
+                                     << "min-leaf" << "labels" << "iterations" << "cache-bytes"
+                                     << "prefetch" << "offsets" << "first" << "count" << "shards"
+                                     << "parallel" << "work-dir" << "query" << "query-id"
+                                     << "queries" << "fuzzy" << "src" << "dst" << "chain"
+                                     << "threads" << "video" << "target" << "particles" << "iters"
+                                     << "hist";
+    for (const QString &name : valueOptions)
+        parser.addOption(QCommandLineOption(name, name, "value"));
+    parser.addOption(QCommandLineOption("verbose", "print debug output"));
+    parser.process(app);
+    Options opt(parser);
+    s_verbose = parser.isSet("verbose") || opt.value("verbose") == "true";
+    QStringList args = parser.positionalArguments();
+    QString command = args.isEmpty() ? QString() : args[0];
+    if (command == "train")
+        return train(opt);
+    if (command == "test")
+        return test(opt);
+    if (command == "recognize")
+        return recognize(opt);
+    if (command == "search")
+        return search(opt);
+    if (command == "preprocess")
+        return preprocess(opt);
+    if (command == "pack")
+        return pack(opt);
+    if (command == "hog")
+        return hog(opt);
+    if (command == "track")
+        return track(opt);
+    parser.showHelp(2);
+}
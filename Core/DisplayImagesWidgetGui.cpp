@@ -3,6 +3,7 @@
 
 #include "Core/DisplayImagesWidgetGui.h"
 #include "ui_DisplayImagesWidgetGui.h"
+#include "ocr/WordCropExtractor.h"
 
 DisplayImagesWidgetGui::DisplayImagesWidgetGui(QWidget *parent) :
     QWidget(parent),
@@ -20,8 +21,6 @@ DisplayImagesWidgetGui::~DisplayImagesWidgetGui()
 void DisplayImagesWidgetGui::display()
 {
     QImage image(m_fNames[m_fileIndex]);
-    cv::Mat img_bw = Util::toCv(image, CV_8UC4);
-    cv::cvtColor(img_bw, img_bw, CV_BGR2GRAY);
     QPixmap pixmap = QPixmap::fromImage(image);
     QImage scaledImage = pixmap.toImage().scaled(pixmap.size() * devicePixelRatio(),
                                                  Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
@@ -39,18 +38,16 @@ void DisplayImagesWidgetGui::extractWords()
     QString saveDir = QFileDialog::getExistingDirectory(this,
                                                         tr("Open Image Direrctory"), QDir::currentPath(),
                                                         QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
-    m_pageParser = new PageParser();
     int size = (int)m_fNames.size();
+    QStringList fileNames;
     for (int i = 0; i < size ; ++i)
-    {
-        QString fileName = m_dir + "/" + m_fNames[i];
-        m_pageParser->readFromTo(fileName, m_words, m_coords);
-        m_pageParser->cropPolygons(fileName, saveDir, m_words, m_coords);
-        m_words.clear();
-        m_coords.clear();
-    }
-    delete m_pageParser;
-    m_pageParser = nullptr;
+        fileNames << m_dir + "/" + m_fNames[i];
+    std::vector<PageWords> pages = PageParser::readPages(fileNames);
+    WordCropExtractor extractor(saveDir);
+    extractor.extract(fileNames, pages);
+    int failed = extractor.finish();
+    if (failed > 0)
+        qWarning() << "ERROR : " << failed << " word images can not be saved!";
 }
 
 void DisplayImagesWidgetGui::browseButton_clicked()
@@ -3,7 +3,7 @@
 #include "Core/ResizeAllImagesDialogGui.h"
 #include "ui_ResizeAllImagesDialogGui.h"
 
-#include "ocr/Reader.h"
+#include "PreprocessChain.h"
 
 
 ResizeAllImagesDialogGui::ResizeAllImagesDialogGui(QWidget *parent) :
@@ -43,27 +43,22 @@ void ResizeAllImagesDialogGui::on_pushButton_resizeall_clicked()
         return;
     }
 
-    std::vector<QString> fNames;
-    auto *reader = new Reader();
-    reader->findImages(m_browseDir, "", fNames);
-    int width = ui->spinBox_width->value();
-    int height = ui->spinBox_height->value();
-
-    for(auto filePath : fNames)
+    if(m_saveDir.isEmpty())
+        selectSaveDir();
+    if(m_saveDir.isEmpty())
     {
-        cv::Mat image = cv::imread(filePath.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
-
-        if(ui->radiobutton_width->isChecked())
-            width = image.cols;
-
-        if(ui->radiobutton_height->isChecked())
-            height = image.rows;
-
-        cv::Size size(width, height);
-        cv::resize(image, image, size);
-        //        cv::imwrite(filePath.toStdString(), image);
+        QMessageBox *msgBox = new QMessageBox();
+        msgBox->setWindowTitle("Error");
+        msgBox->setText("You Should First Choose Save Folder ");
+        msgBox->show();
+        return;
     }
 
+    // 0 keeps the side of each image
+    int width = ui->radiobutton_width->isChecked() ? 0 : ui->spinBox_width->value();
+    int height = ui->radiobutton_height->isChecked() ? 0 : ui->spinBox_height->value();
+    int written = PreprocessChain().resize(width, height).run(m_browseDir, m_saveDir);
+    qDebug() << written << " images written to " << m_saveDir;
     qDebug() << " Resizing Done" ;
 }
 
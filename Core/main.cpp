@@ -5,9 +5,7 @@
 #include "Core/MainWindowGui.h"
 #include "ocr/Reader.h"
 #include "rdf/RandomDecisionForest.h"
-
-
-#include "modules/tracking/dataExtraction/HOGExtactor.h"
+#include "rdf/ShardedRecognition.h"
 
 int main(int argc, char *argv[])
 {
@@ -55,12 +53,19 @@ int main(int argc, char *argv[])
 //        qDebug() << "test label count : " << mnist.m_testLabels->size();
 //        qDebug() << "train label count : " << mnist.m_trainLabels->size();
 //        mnist.extractDataSet(destdir);
+    // headless batch modes, no window is created
+    if (argc > 1 && QString(argv[1]) == "--recognize-shard")
+    {
+        QCoreApplication app(argc, argv);
+        return ShardedRecognition::runShard(app.arguments().mid(2));
+    }
+    if (argc > 1 && QString(argv[1]) == "--recognize-sharded")
+    {
+        QCoreApplication app(argc, argv);
+        return ShardedRecognition::runCoordinator(app.arguments().mid(2));
+    }
     QApplication app(argc, argv);
     MainWindowGui w;
     w.show();
-
-    HOGExtactor *hogExtr = new HOGExtactor();
-    std::cout << hogExtr->getDataSize() << std::endl;
-
     return app.exec();
 }
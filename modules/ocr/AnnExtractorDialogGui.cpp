@@ -162,7 +162,7 @@ void AnnExtractorDialogGui::createSaveDir()
         dir_save.mkpath(".");
 
         if(!dir_save.exists())
-            qDebug() << "ERROR : " << dir_save << " can not be created!" ;
+            qWarning() << "ERROR : " << dir_save << " can not be created!" ;
     }
 }
 
@@ -338,7 +338,7 @@ void AnnExtractorDialogGui::display()
 {
     cv::Mat input = cv::imread(m_fNames[m_fileIndex].toStdString(),
                                CV_LOAD_IMAGE_GRAYSCALE);
-    QImage image = Util::toQt(input, QImage::Format_RGB888);
+    QImage image = Util::wrapQt(input);
     QPixmap pixmap = QPixmap::fromImage(image);
     QImage scaledImage = pixmap.toImage().scaled(pixmap.size() * devicePixelRatio(),
                          Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
@@ -0,0 +1,237 @@
+#include "precompiled.h"
+
+#include <iostream>
+
+#include "ocr/DatasetManifest.h"
+
+// bumped whenever the file layout changes
+static const quint32 MANIFEST_VERSION = 3;
+
+static QDataStream &operator<<(QDataStream &out, const ManifestDir &dir)
+{
+    return out << dir.m_mtime << dir.m_subdirs << dir.m_files;
+}
+
+static QDataStream &operator>>(QDataStream &in, ManifestDir &dir)
+{
+    return in >> dir.m_mtime >> dir.m_subdirs >> dir.m_files;
+}
+
+static QVector<QRegExp> wildcards(const QStringList &filters, Qt::CaseSensitivity cs)
+{
+    QVector<QRegExp> result;
+    for (const QString &filter : filters)
+        result.push_back(QRegExp(filter, cs, QRegExp::Wildcard));
+    return result;
+}
+
+static bool matchesAny(const QVector<QRegExp> &patterns, const QString &name)
+{
+    for (const QRegExp &pattern : patterns)
+        if (pattern.exactMatch(name))
+            return true;
+    return false;
+}
+
+// folder levels below the root, the root itself is at 0
+static int depthOf(const QString &relDir)
+{
+    return relDir.isEmpty() ? 0 : relDir.count('/') + 1;
+}
+
+DatasetManifest::DatasetManifest(const QString &baseDir)
+    : m_baseDir(baseDir), m_root(QFileInfo(baseDir).absoluteFilePath())
+{
+}
+
+std::shared_ptr<const DatasetManifest> DatasetManifest::open(const QString &baseDir,
+        int depth, int nThreads)
+{
+    static QMutex mutex;
+    static QHash<QString, std::shared_ptr<const DatasetManifest>> opened;
+    std::shared_ptr<DatasetManifest> manifest(new DatasetManifest(baseDir));
+    std::shared_ptr<const DatasetManifest> previous;
+    {
+        QMutexLocker locker(&mutex);
+        previous = opened.value(manifest->m_root);
+    }
+    // crawls of different roots run side by side, two concurrent refreshes of
+    // the same root both produce a valid snapshot and the last one is kept
+    if (previous)
+        manifest->m_dirs = previous->m_dirs;
+    else
+        manifest->load();
+    if (manifest->refresh(depth, nThreads))
+        manifest->save();
+    QMutexLocker locker(&mutex);
+    opened.insert(manifest->m_root, manifest);
+    return manifest;
+}
+
+QString DatasetManifest::manifestFile() const
+{
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QByteArray key = QCryptographicHash::hash(m_root.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return cacheDir + "/manifests/" + key + ".bin";
+}
+
+QString DatasetManifest::pathOf(const QString &relDir, const QString &name) const
+{
+    return relDir.isEmpty() ? m_baseDir + "/" + name : m_baseDir + "/" + relDir + "/" + name;
+}
+
+bool DatasetManifest::load()
+{
+    QFile input(manifestFile());
+    if (!input.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&input);
+    quint32 version;
+    QString root;
+    in >> version >> root;
+    if (version != MANIFEST_VERSION || root != m_root)
+        return false;
+    in >> m_dirs;
+    if (in.status() != QDataStream::Ok)
+    {
+        m_dirs.clear();
+        return false;
+    }
+    return true;
+}
+
+bool DatasetManifest::save() const
+{
+    QString fileName = manifestFile();
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile output(fileName);
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "DatasetManifest::save failed to open file! \n";
+        return false;
+    }
+    QDataStream out(&output);
+    out << MANIFEST_VERSION << m_root << m_dirs;
+    return output.commit();
+}
+
+bool DatasetManifest::refresh(int depth, int nThreads)
+{
+    if (nThreads <= 0)
+        nThreads = QThread::idealThreadCount();
+    QHash<QString, ManifestDir> previous;
+    previous.swap(m_dirs);
+    bool changed = false;
+    // breadth first, the directories of one level are stat'ed / listed in parallel
+    QStringList level;
+    level << QString();
+    for (int d = 0; !level.isEmpty(); ++d)
+    {
+        int nDirs = level.size();
+        std::vector<ManifestDir> entries(nDirs);
+        std::vector<char> exists(nDirs, 1), relisted(nDirs, 0);
+        #pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+        for (int i = 0; i < nDirs; ++i)
+        {
+            QString absDir = level[i].isEmpty() ? m_root : m_root + "/" + level[i];
+            QFileInfo dirInfo(absDir);
+            if (!dirInfo.isDir())
+            {
+                exists[i] = 0;
+                continue;
+            }
+            ManifestDir &entry = entries[i];
+            entry.m_mtime = dirInfo.lastModified().toMSecsSinceEpoch();
+            auto old = previous.constFind(level[i]);
+            if (old != previous.constEnd() && old->m_mtime == entry.m_mtime)
+            {
+                entry = *old;
+                continue;
+            }
+            relisted[i] = 1;
+            QDir dir(absDir);
+            // a link back up the tree would never end the crawl
+            entry.m_subdirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks,
+                                            QDir::Name);
+            entry.m_files = dir.entryList(QDir::Files, QDir::Name);
+        }
+        QStringList next;
+        for (int i = 0; i < nDirs; ++i)
+        {
+            if (!exists[i])
+            {
+                changed = true;
+                continue;
+            }
+            changed = changed || relisted[i];
+            if (depth == FULL_DEPTH || d < depth)
+                for (const QString &sub : entries[i].m_subdirs)
+                    next << (level[i].isEmpty() ? sub : level[i] + "/" + sub);
+            m_dirs.insert(level[i], std::move(entries[i]));
+        }
+        level.swap(next);
+    }
+    // below the crawled depth the previous snapshot is kept as it is, as long
+    // as its ancestor at that depth still exists
+    if (depth != FULL_DEPTH)
+    {
+        for (auto it = previous.constBegin(); it != previous.constEnd(); ++it)
+        {
+            if (depthOf(it.key()) <= depth)
+                continue;
+            QString ancestor = depth == 0 ? QString() : it.key().section('/', 0, depth - 1);
+            if (m_dirs.contains(ancestor))
+                m_dirs.insert(it.key(), *it);
+        }
+    }
+    // directories that disappeared
+    changed = changed || previous.size() != m_dirs.size();
+    return changed;
+}
+
+void DatasetManifest::files(const QStringList &nameFilters, const QString &folderFilter,
+                            std::vector<QString> &paths, std::vector<QString> *labels) const
+{
+    auto root = m_dirs.constFind(QString());
+    if (root == m_dirs.constEnd())
+        return;
+    QRegExp folderPattern(folderFilter, Qt::CaseSensitive, QRegExp::Wildcard);
+    QVector<QRegExp> patterns = wildcards(nameFilters, Qt::CaseInsensitive);
+    for (const QString &folder : root->m_subdirs)
+    {
+        if (!folderPattern.exactMatch(folder))
+            continue;
+        auto dir = m_dirs.constFind(folder);
+        if (dir == m_dirs.constEnd())
+            continue;
+        for (const QString &file : dir->m_files)
+        {
+            if (!matchesAny(patterns, file))
+                continue;
+            paths.push_back(pathOf(folder, file));
+            if (labels)
+                labels->push_back(folder);
+        }
+    }
+}
+
+void DatasetManifest::filesRecursive(const QStringList &nameFilters,
+                                     std::vector<QString> &paths) const
+{
+    QVector<QRegExp> patterns = wildcards(nameFilters, Qt::CaseInsensitive);
+    // depth first in name order
+    QStringList stack;
+    stack << QString();
+    while (!stack.isEmpty())
+    {
+        QString relDir = stack.takeLast();
+        auto dir = m_dirs.constFind(relDir);
+        if (dir == m_dirs.constEnd())
+            continue;
+        for (const QString &file : dir->m_files)
+            if (matchesAny(patterns, file))
+                paths.push_back(pathOf(relDir, file));
+        for (int i = dir->m_subdirs.size() - 1; i >= 0; --i)
+            stack << (relDir.isEmpty() ? dir->m_subdirs[i] : relDir + "/" + dir->m_subdirs[i]);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef CPV_DATASET_MANIFEST
+#define CPV_DATASET_MANIFEST
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+struct ManifestDir
+{
+    qint64 m_mtime;
+    QStringList m_subdirs;      // names, sorted
+    QStringList m_files;        // names, sorted
+};
+
+// Directory tree of a dataset (the paths of all files) kept in one binary
+// file under the user cache directory. A refresh only stats directories
+// and re-lists the ones whose mtime changed; the first crawl lists each level
+// of the tree in parallel. Labels are the names of the first level folders.
+// Symbolic links to directories are not followed.
+class DatasetManifest
+{
+  public:
+    static const int FULL_DEPTH = -1;
+
+    // refreshed manifest of baseDir, shared by all callers of the process.
+    // Only the directories up to depth folder levels below baseDir are crawled,
+    // deeper ones keep what an earlier deeper open recorded
+    static std::shared_ptr<const DatasetManifest> open(const QString &baseDir,
+            int depth = FULL_DEPTH, int nThreads = 0);
+
+    // files matching nameFilters inside the first level folders matching
+    // folderFilter, needs depth >= 1
+    void files(const QStringList &nameFilters, const QString &folderFilter,
+               std::vector<QString> &paths, std::vector<QString> *labels = nullptr) const;
+    // files matching nameFilters anywhere below the base directory, needs FULL_DEPTH
+    void filesRecursive(const QStringList &nameFilters, std::vector<QString> &paths) const;
+
+    inline int dirCount() const
+    {
+        return m_dirs.size();
+    }
+
+    static QStringList imageFilters()
+    {
+        return QStringList() << "*.jpg" << "*.jpeg" << "*.png";
+    }
+
+  private:
+    explicit DatasetManifest(const QString &baseDir);
+
+    // true when anything changed
+    bool refresh(int depth, int nThreads);
+    bool load();
+    bool save() const;
+    QString manifestFile() const;
+    QString pathOf(const QString &relDir, const QString &name) const;
+
+    QString m_baseDir;      // as given by the caller, prefix of all returned paths
+    QString m_root;         // absolute
+    QHash<QString, ManifestDir> m_dirs;     // relative dir ("" is the root) -> entry
+};
+
+#endif
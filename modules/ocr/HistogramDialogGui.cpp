@@ -15,6 +15,13 @@ HistogramDialogGui::~HistogramDialogGui()
     delete ui;
 }
 
+void HistogramDialogGui::plot(const cv::Mat &hist, QWidget *parent, const QString title)
+{
+    HistogramDialogGui *histDialog = new HistogramDialogGui(parent);
+    histDialog->show();
+    histDialog->plot(hist, title);
+}
+
 void HistogramDialogGui::plot(const cv::Mat &hist, const QString title)
 {
     // Compute Histogram
@@ -17,6 +17,8 @@ class HistogramDialogGui : public QDialog
   public:
     explicit HistogramDialogGui(QWidget *parent = 0);
     void plot(const cv::Mat &hist, const QString title);
+    // opens a new non-modal dialog plotting hist
+    static void plot(const cv::Mat &hist, QWidget *parent, const QString title);
     ~HistogramDialogGui();
   private:
     Ui::HistogramDialogGui *ui;
@@ -0,0 +1,51 @@
+#include "precompiled.h"
+
+#include "ocr/PageImage.h"
+
+PageImage::PageImage(const QString &path, int layoutScale) : m_path(path)
+{
+    m_scale = (layoutScale == 2 || layoutScale == 4 || layoutScale == 8) ? layoutScale : 1;
+}
+
+const cv::Mat &PageImage::layoutImage()
+{
+    if (!m_reduced.empty())
+        return m_reduced;
+    int flags = CV_LOAD_IMAGE_GRAYSCALE;
+    if (m_scale == 2)
+        flags = cv::IMREAD_REDUCED_GRAYSCALE_2;
+    else if (m_scale == 4)
+        flags = cv::IMREAD_REDUCED_GRAYSCALE_4;
+    else if (m_scale == 8)
+        flags = cv::IMREAD_REDUCED_GRAYSCALE_8;
+    m_reduced = cv::imread(m_path.toStdString(), flags);
+    // at scale 1 the layout image already is the full page
+    if (m_scale == 1)
+        m_full = m_reduced;
+    return m_reduced;
+}
+
+PageLayout PageImage::layout()
+{
+    if (layoutImage().empty())
+        return PageLayout();
+    return TextRegionDetector::analyzePage(TextRegionDetector::binarizePage(m_reduced), m_scale);
+}
+
+cv::Mat PageImage::crop(const QRect &rect)
+{
+    if (m_full.empty())
+    {
+        m_full = cv::imread(m_path.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
+        if (m_full.empty())
+        {
+            qWarning() << "ERROR : " << m_path << " can not be read!";
+            return cv::Mat();
+        }
+    }
+    cv::Rect roi = cv::Rect(rect.x(), rect.y(), rect.width(), rect.height())
+                   & cv::Rect(0, 0, m_full.cols, m_full.rows);
+    if (roi.area() == 0)
+        return cv::Mat();
+    return m_full(roi);
+}
@@ -0,0 +1,42 @@
+#ifndef CPV_PAGE_IMAGE
+#define CPV_PAGE_IMAGE
+
+#include <opencv2/core.hpp>
+#include <QString>
+#include <QRect>
+
+#include "ocr/TextRegionDetector.h"
+
+// A scanned page decoded as little as possible : layout analysis runs on a
+// reduced resolution decode (the JPEG decoder skips the work with IMREAD_REDUCED_*),
+// the full resolution page is only decoded when the first crop is requested.
+class PageImage
+{
+  public:
+    // layoutScale is 1, 2, 4 or 8, other values fall back to 1
+    explicit PageImage(const QString &path, int layoutScale = 1);
+
+    // grayscale page at 1/layoutScale, decoded on first use
+    const cv::Mat &layoutImage();
+    // line and word rectangles in full resolution coordinates
+    PageLayout layout();
+    // full resolution grayscale view of rect, clipped to the page
+    cv::Mat crop(const QRect &rect);
+
+    inline int layoutScale() const
+    {
+        return m_scale;
+    }
+    inline bool isFullResolutionLoaded() const
+    {
+        return !m_full.empty();
+    }
+
+  private:
+    QString m_path;
+    int m_scale;
+    cv::Mat m_reduced;
+    cv::Mat m_full;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "precompiled.h"
 
 #include "ocr/PageParser.h"
+#include "ocr/WordCropExtractor.h"
 #include "Util.h"
 
 void PageParser::readFromTo(QString filename, std::vector<QString> &words,
@@ -8,24 +9,87 @@ void PageParser::readFromTo(QString filename, std::vector<QString> &words,
 {
     this->words = &words;
     this->coords = &coords;
-    QDomDocument document;
+    parsePage(filename, words, coords);
+}
+
+bool PageParser::parsePage(const QString &filename, std::vector<QString> &words,
+                           std::vector<QString> &coords)
+{
     //Load the file
     QFile file(filename + ".xml");
     if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Failed to open file";
+        return false;
     }
-    else
+    // single forward pass : for every Word the first Coords and the first
+    // Unicode below it in document order, as the DOM lookups used to pick
+    std::vector<QString> pageWords;
+    std::vector<QString> pageCoords;
+    QXmlStreamReader xml(&file);
+    int wordDepth = 0;              // > 0 while inside a Word
+    bool hasCoords = false, hasUnicode = false;
+    QString word, points;
+    while(!xml.atEnd())
     {
-        if(!document.setContent(&file))
+        QXmlStreamReader::TokenType token = xml.readNext();
+        if(token == QXmlStreamReader::StartElement)
         {
-            qDebug() << "Failed to load document";
+            if(wordDepth > 0)
+            {
+                ++wordDepth;
+                if(!hasCoords && xml.name() == QLatin1String("Coords"))
+                {
+                    points = xml.attributes().value("points").toString();
+                    hasCoords = true;
+                }
+                else if(!hasUnicode && xml.name() == QLatin1String("Unicode"))
+                {
+                    word = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+                    hasUnicode = true;
+                    // readElementText consumed the end element
+                    --wordDepth;
+                }
+            }
+            else if(xml.name() == QLatin1String("Word"))
+            {
+                wordDepth = 1;
+                hasCoords = hasUnicode = false;
+                word.clear();
+                points.clear();
+            }
+        }
+        else if(token == QXmlStreamReader::EndElement && wordDepth > 0)
+        {
+            if(--wordDepth == 0 && word != "")
+            {
+                //            word = Util::cleanNumberAndPunctuation(word);
+                pageWords.push_back(word);
+                pageCoords.push_back(points);
+            }
         }
-        file.close();
     }
-    //get the root element
-    QDomElement root = document.firstChildElement();
-    getElements(root, "Word", "Coords", "Unicode");
+    file.close();
+    if(xml.hasError())
+    {
+        qWarning() << "Failed to load document" << filename << xml.errorString();
+        return false;
+    }
+    words.insert(words.end(), pageWords.begin(), pageWords.end());
+    coords.insert(coords.end(), pageCoords.begin(), pageCoords.end());
+    return true;
+}
+
+std::vector<PageWords> PageParser::readPages(const QStringList &filenames, int nThreads)
+{
+    if(nThreads <= 0)
+        nThreads = QThread::idealThreadCount();
+    int nPages = filenames.size();
+    std::vector<PageWords> pages(nPages);
+    #pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+    for(int i = 0; i < nPages; ++i)
+        parsePage(filenames[i], pages[i].m_words, pages[i].m_coords);
+    return pages;
 }
 
 void PageParser::getElements(QDomElement root, QString tagname,
@@ -61,48 +125,9 @@ void PageParser::cropPolygons(const QString filename, QString saveDir,
                               std::vector<QString> &words,
                               std::vector<QString> &coordinates)
 {
-    QImage image(filename + ".jpg");
     qDebug() << "Scanning " << (filename + ".jpg");
     qDebug() << "Number of words :" << words.size();
     qDebug() << "Number of words :" << coordinates.size();
-    int size = words.size();
-    for(int j = 0; j < size; ++j)
-    {
-        //each word represents a directory name
-        QString word   = saveDir + "/" + words[j];
-        //check if directory exist
-        QDir dir(word);
-        if (!dir.exists())
-        {
-            dir.mkpath(".");
-            if(!dir.exists())
-                qDebug() << "ERROR : " << dir << " can not be created!" ;
-        }
-        QString coordsStr = coordinates[j];
-        QStringList coords = coordsStr.split(" ");
-        QPolygon poly;
-        int count = coords.count();
-        for(int i = 0; i < count; ++i)
-        {
-            QString pointStr = coords[i];
-            QStringList pointCoords = pointStr.split(",");
-            int x = pointCoords[0].trimmed().toInt();
-            int y = pointCoords[1].trimmed().toInt();
-            poly <<  QPoint(x, y);
-        }
-        QRect rect =  poly.boundingRect();
-        QImage cropped = image.copy(rect);
-        cv::Mat croppedMat = Util::toCv(cropped, CV_8UC4);
-        cv::Mat im_gray, img_bw;
-        cv::cvtColor(croppedMat, im_gray, CV_BGR2GRAY);
-        cv::threshold(im_gray, img_bw, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
-        //        QImage saveQIM = Util::toQt(img_bw, QImage::Format_RGB888);
-        QImage saveQIM = Util::toQt(im_gray, QImage::Format_RGB888);
-        QFileInfo fileInfo(filename);
-        QString fileNameWithoutExt = fileInfo.fileName();
-        QString fnameToSave = word + "/" + fileNameWithoutExt + QString::number(
-                                  j) + ".jpg";
-        if(!saveQIM.save(fnameToSave))
-            qDebug() << "ERROR : " << fnameToSave << " can not be saved!" ;
-    }
+    WordCropExtractor extractor(saveDir);
+    extractor.addPage(filename, words, coordinates);
 }
@@ -10,11 +10,24 @@
 
 
 
+// words and their polygon points of one PAGE XML file
+struct PageWords
+{
+    std::vector<QString> m_words;
+    std::vector<QString> m_coords;
+};
+
 class PageParser
 {
   public:
     void readFromTo(QString filename, std::vector<QString> &words,
                     std::vector<QString> &coords);
+    // streams filename.xml with QXmlStreamReader and appends its non empty
+    // words and "x,y x,y ..." points, nothing is appended if the file is broken
+    static bool parsePage(const QString &filename, std::vector<QString> &words,
+                          std::vector<QString> &coords);
+    // parses the files concurrently, result i belongs to filenames[i]
+    static std::vector<PageWords> readPages(const QStringList &filenames, int nThreads = 0);
     void getElements(QDomElement root, QString tagname, QString attribute1,
                      QString attribute2);
     void cropPolygons(const QString filename, QString saveDir,
@@ -0,0 +1,66 @@
+#include "precompiled.h"
+
+#include "ocr/ProjectionProfile.h"
+
+ProjectionProfile::ProjectionProfile(const cv::Mat &img)
+{
+    cv::integral(img, m_integral, CV_64F);
+}
+
+cv::Mat_<float> ProjectionProfile::rowProfile(int rowBegin, int rowEnd, int colBegin,
+                                              int colEnd) const
+{
+    cv::Mat_<float> profile(rowEnd - rowBegin, 1);
+    const double *top = m_integral[rowBegin];
+    for (int r = rowBegin; r < rowEnd; ++r)
+    {
+        const double *bottom = m_integral[r + 1];
+        profile(r - rowBegin) = (bottom[colEnd] - bottom[colBegin]) - (top[colEnd] - top[colBegin]);
+        top = bottom;
+    }
+    return profile;
+}
+
+cv::Mat_<float> ProjectionProfile::colProfile(int rowBegin, int rowEnd, int colBegin,
+                                              int colEnd) const
+{
+    cv::Mat_<float> profile(colEnd - colBegin, 1);
+    const double *top = m_integral[rowBegin];
+    const double *bottom = m_integral[rowEnd];
+    for (int c = colBegin; c < colEnd; ++c)
+        profile(c - colBegin) = (bottom[c + 1] - bottom[c]) - (top[c + 1] - top[c]);
+    return profile;
+}
+
+cv::Mat_<float> ProjectionProfile::columnSums(const cv::Mat &img)
+{
+    cv::Mat sums;
+    cv::reduce(img, sums, 0, cv::REDUCE_SUM, CV_32F);
+    return sums.reshape(1, img.cols);
+}
+
+QVector<int> ProjectionProfile::runs(const QVector<int> &mask, int maxGap)
+{
+    QVector<int> result;
+    int range = mask.size();
+    int i = 0;
+    while (i < range)
+    {
+        if (mask[i] == 0)
+        {
+            ++i;
+            continue;
+        }
+        int start = i;
+        while (i < range && mask[i] != 0)
+            ++i;
+        if (!result.isEmpty() && start - result.back() < maxGap)
+            result.back() = i;
+        else
+        {
+            result.push_back(start);
+            result.push_back(i);
+        }
+    }
+    return result;
+}
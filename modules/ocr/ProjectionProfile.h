@@ -0,0 +1,39 @@
+#ifndef CPV_PROJECTION_PROFILE
+#define CPV_PROJECTION_PROFILE
+
+#include <opencv2/core.hpp>
+#include <QVector>
+
+// Projection profiles of a page taken from a single integral image : the sum of
+// any row or column over any band costs two lookups, so line and word profiles
+// of a whole page come out of one pass over the pixels.
+class ProjectionProfile
+{
+  public:
+    explicit ProjectionProfile(const cv::Mat &img);
+
+    inline int rows() const
+    {
+        return m_integral.rows - 1;
+    }
+    inline int cols() const
+    {
+        return m_integral.cols - 1;
+    }
+
+    // (rowEnd - rowBegin) x 1 row sums over the columns [colBegin, colEnd)
+    cv::Mat_<float> rowProfile(int rowBegin, int rowEnd, int colBegin, int colEnd) const;
+    // (colEnd - colBegin) x 1 column sums over the rows [rowBegin, rowEnd)
+    cv::Mat_<float> colProfile(int rowBegin, int rowEnd, int colBegin, int colEnd) const;
+
+    // cols x 1 column sums of img with a single cv::reduce, for one-off bands
+    static cv::Mat_<float> columnSums(const cv::Mat &img);
+    // [start, end) pairs of the non-zero runs of mask, runs separated by less
+    // than maxGap zeros are merged
+    static QVector<int> runs(const QVector<int> &mask, int maxGap);
+
+  private:
+    cv::Mat_<double> m_integral;
+};
+
+#endif
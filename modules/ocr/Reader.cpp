@@ -1,6 +1,7 @@
 #include "precompiled.h"
 
 #include "Reader.h"
+#include "ocr/DatasetManifest.h"
 
 void Reader::readFromTo(std::string filename, std::vector<QString> &imgName)
 {
@@ -37,83 +38,31 @@ void Reader::findImages(QString baseDir, QString query,
                         std::vector<QString> &foundImages , std::vector<QString> &labels)
 {
     query = "*" + query + "*";
-    QDirIterator it(baseDir, QStringList() << query, QDir::Dirs | QDir::NoDotAndDotDot | QDir::CaseSensitive) ;
-    while (it.hasNext())
-    {
-        it.next();
-        QDirIterator itFile(baseDir + "/" + it.fileName(), QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files);
-        while(itFile.hasNext())
-        {
-            itFile.next();
-            foundImages.push_back(itFile.filePath());
-            labels.push_back(it.fileName());
-        }
-    }
+    DatasetManifest::open(baseDir, 1)->files(DatasetManifest::imageFilters(), query, foundImages,
+                                             &labels);
 }
 
 void Reader::findImages(QString baseDir, QString query,
                         std::vector<QString> &foundImages)
 {
     query = "*" + query + "*";
-    QDirIterator it(baseDir, QStringList() << query,
-                    QDir::Dirs | QDir::NoDotAndDotDot | QDir::CaseSensitive) ;
-    while (it.hasNext())
-    {
-        it.next();
-        QDirIterator itFile(baseDir + "/" + it.fileName(),
-                            QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files);
-        while(itFile.hasNext())
-        {
-            itFile.next();
-            foundImages.push_back(itFile.filePath());
-        }
-    }
+    DatasetManifest::open(baseDir, 1)->files(DatasetManifest::imageFilters(), query, foundImages);
 }
 
 void Reader::findImages(QString baseDir, std::vector<QString> &foundImages)
 {
-    QDirIterator itFile(baseDir, QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files,
-                        QDirIterator::Subdirectories);
-    while(itFile.hasNext())
-    {
-        itFile.next();
-        foundImages.push_back(itFile.filePath());
-    }
+    DatasetManifest::open(baseDir)->filesRecursive(DatasetManifest::imageFilters(), foundImages);
 }
 
 
 void Reader::readTextFiles(QString baseDir, QString query,
                            std::vector<QString> &foundText)
 {
-    QDirIterator it(baseDir, QStringList() << query,
-                    QDir::Dirs | QDir::NoDotAndDotDot | QDir::CaseSensitive) ;
-    while (it.hasNext())
-    {
-        it.next();
-        QDirIterator itFile(baseDir + "/" + it.fileName(), QStringList() << "*.txt",
-                            QDir::Files);
-        while(itFile.hasNext())
-        {
-            itFile.next();
-            foundText.push_back(itFile.filePath());
-        }
-    }
+    DatasetManifest::open(baseDir, 1)->files(QStringList() << "*.txt", query, foundText);
 }
 
 
 void Reader::readTextFiles(QString baseDir, std::vector<QString> &foundText)
 {
-    QDirIterator it(baseDir, QStringList() << "*",
-                    QDir::Dirs | QDir::NoDotAndDotDot | QDir::CaseSensitive) ;
-    while (it.hasNext())
-    {
-        it.next();
-        QDirIterator itFile(baseDir + "/" + it.fileName(), QStringList() << "*.txt",
-                            QDir::Files);
-        while(itFile.hasNext())
-        {
-            itFile.next();
-            foundText.push_back(itFile.filePath());
-        }
-    }
+    readTextFiles(baseDir, "*", foundText);
 }
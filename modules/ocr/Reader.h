@@ -7,7 +7,7 @@
 #include <QString>
 #include <QDir>
 #include <QDebug>
-#include <QApplication>
+#include <QCoreApplication>
 #include <QDirIterator>
 
 #include <dirent.h>
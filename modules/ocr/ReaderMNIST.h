@@ -33,7 +33,7 @@ class MNIST
     {
         if(!img.save(savedir))
         {
-            qDebug() << "Error Saving File !";
+            qWarning() << "Error Saving File !";
             return;
         }
     }
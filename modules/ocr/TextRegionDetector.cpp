@@ -3,8 +3,21 @@
 #include <iostream>
 
 #include "ocr/TextRegionDetector.h"
+#include "ocr/PageImage.h"
 #include "Util.h"
 
+// layout constants below are tuned for full resolution pages, these rescale
+// them for pages decoded at 1/scale
+static inline int scaled(int px, int scale)
+{
+    return std::max(1, px / scale);
+}
+
+static inline int scaledKernel(int ksize, int scale)
+{
+    return scaled(ksize, scale) | 1;
+}
+
 
 QVector<QRect> TextRegionDetector::detectWordsFromLine(cv::Mat &lineImg,
         QWidget *parent)
@@ -17,12 +30,8 @@ QVector<QRect> TextRegionDetector::detectWordsFromLine(cv::Mat &lineImg,
     //    cv::imshow("line Image", lineImg);
     // calculate histogram
     int range = lineImg.cols;
-
-    for (int i = 0; i < range; ++i)
-        hist.push_back(cv::sum(lineImg.col(i))[0]);
-
-    // convert to CV_32FC1 and normalize
-    hist.convertTo(hist, CV_32FC1);
+    hist = ProjectionProfile::columnSums(lineImg);
+    // normalize
     double minVal, maxVal;
     cv::minMaxLoc(hist, &minVal, &maxVal);
     hist = hist / maxVal;
@@ -62,9 +71,17 @@ QVector<QRect> TextRegionDetector::detectWordsFromLine(cv::Mat &lineImg,
 QVector<QRect> TextRegionDetector::detectRegions(const cv::Mat &img_bw,
         QWidget *parent)
 {
+    Q_UNUSED(parent);
+    return analyzePage(img_bw).m_words;
+}
+
+PageLayout TextRegionDetector::analyzePage(const cv::Mat &img_bw, int scale)
+{
+    // every line and word profile below comes from this single pass
+    ProjectionProfile profile(img_bw);
     int leftMargin = 0, rightMargin = img_bw.cols;
     //    qDebug() << "Default: " << leftMargin << "  " << rightMargin;
-    getRange(img_bw, leftMargin, rightMargin, parent);
+    getRange(profile, leftMargin, rightMargin, scale);
     //    leftMargin = leftMargin - 50;
     //    rightMargin = rightMargin + 50;
     //    if(leftMargin < 0)
@@ -74,17 +91,9 @@ QVector<QRect> TextRegionDetector::detectRegions(const cv::Mat &img_bw,
     qDebug() << "Computed: " << leftMargin << "  " << rightMargin;
     qDebug() << "Image size: " << img_bw.rows << "  " << img_bw.cols;
     // calculate histogram
-    QVector<QRect> result;
+    PageLayout result;
     int range = img_bw.rows;
-    cv::Mat hist;
-
-    for (int i = 0; i < range; ++i)
-    {
-        int tmp = cv::sum(img_bw.row(i))[0];
-        hist.push_back(tmp);
-    }
-
-    hist.convertTo(hist, CV_32FC1);
+    cv::Mat hist = profile.rowProfile(0, range, 0, img_bw.cols);
     double minVal, maxVal;
     cv::minMaxLoc(hist, &minVal, &maxVal);
     hist = hist / maxVal;
@@ -103,7 +112,7 @@ QVector<QRect> TextRegionDetector::detectRegions(const cv::Mat &img_bw,
             y[i] = 1;
     }
 
-    QVector<int> line_y = extractCoordinateFrom(y);
+    QVector<int> line_y = extractCoordinateFrom(y, scale);
     y.clear();
     qDebug() << " line_y: " << line_y.size();
     // for each line
@@ -114,25 +123,16 @@ QVector<QRect> TextRegionDetector::detectRegions(const cv::Mat &img_bw,
     for (int row = 0; row < line_y.size() - 1; row += 2)
     {
         //    for (int row = 20; row < 21; row+=2) {
-        if(line_y[row + 1] - line_y[row] < 10)
+        if(line_y[row + 1] - line_y[row] < scaled(10, scale))
             continue;
 
         //        qDebug() << row << " line: " << line_y[row] << " " << line_y[row+1];
-        hist.release();
-
-        for (int i = leftMargin; i < rightMargin; ++i)
-        {
-            int tmp = cv::sum(img_bw(cv::Range(line_y[row], line_y[row + 1]), cv::Range(i,
-                                     i + 1)))[0];
-            hist.push_back(tmp);
-        }
-
-        hist.convertTo(hist, CV_32FC1);
+        hist = profile.colProfile(line_y[row], line_y[row + 1], leftMargin, rightMargin);
         cv::minMaxLoc(hist, &minVal, &maxVal);
         hist = hist / maxVal;
         // TODO: WHat is 10? make it line specific as well
         //        Util::plot(hist,parent);
-        int ksize = 51;
+        int ksize = scaledKernel(51, scale);
         //        cv::blur(hist,hist,cv::Size(ksize,ksize));
         //        cv::medianBlur(hist,hist,ksize);
         cv::GaussianBlur(hist, hist, cv::Size(ksize, ksize), 0, 0);
@@ -154,70 +154,118 @@ QVector<QRect> TextRegionDetector::detectRegions(const cv::Mat &img_bw,
                 x[i] = 1;
         }
 
-        line_x = extractCoordinateFrom(x);
+        line_x = extractCoordinateFrom(x, scale);
         //        qDebug() << row << " line_x: " << line_x.size();
         int w, h = line_y[row + 1] - line_y[row];
+        result.m_lines.push_back(QRect(leftMargin, line_y[row], range, h));
 
         for (int i = 0; i < line_x.size(); i += 2)
         {
             w = line_x[i + 1] - line_x[i];
-            result.push_back(QRect(line_x[i] + leftMargin, line_y[row], w, h));
+            result.m_words.push_back(QRect(line_x[i] + leftMargin, line_y[row], w, h));
         }
 
         line_x.clear();
     }
 
-    qDebug() << "I am done " << result.size();
+    qDebug() << "I am done " << result.m_words.size();
+    // back to full resolution page coordinates
+    if (scale > 1)
+    {
+        for (QRect &rect : result.m_lines)
+            rect = QRect(rect.topLeft() * scale, rect.size() * scale);
+        for (QRect &rect : result.m_words)
+            rect = QRect(rect.topLeft() * scale, rect.size() * scale);
+    }
     return result;
 }
 
-
-QVector<int> TextRegionDetector::extractCoordinateFrom(QVector<int> coord)
+cv::Mat TextRegionDetector::binarizePage(const cv::Mat &img_gray)
 {
-    // look for tmp reagion to merge
-    int range = coord.size();
-    int tmp = 15;
-
-    for (int i = tmp; i < range; ++i)
-        if (coord[i] == 1)
-            for (int j = i - tmp; j < i; ++j)
-                if (coord[j] == 1)
-                    for (; j < i; ++j)
-                        coord[j] = 1;
-
-    QVector<int> result;
-    //add dumy
-    result.push_back(0);
-    bool start = false;
+    cv::Mat img_bw;
+    cv::threshold(img_gray, img_bw, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
+    img_bw.convertTo(img_bw, CV_32FC1);
+    img_bw = 255 - img_bw;
+    return img_bw;
+}
 
-    for (int i = 0; i < range; ++i)
+// Pages are decoded (at 1/scale, see PageImage), binarized and segmented on
+// nWorkers threads, rectangles are in full resolution coordinates. The output
+// file then gets one line per page, in input order :
+// "<page>\t<nLines> <x y w h>... <nWords> <x y w h>..."
+// Pages that cannot be read or segmented are written with no rectangles.
+bool TextRegionDetector::detectRegionsBatch(const QStringList &pages,
+        const QString &outFile, int nWorkers, int scale)
+{
+    if (nWorkers <= 0)
+        nWorkers = QThread::idealThreadCount();
+    int nPages = pages.size();
+    std::vector<PageLayout> layouts(nPages);
+    #pragma omp parallel for schedule(dynamic) num_threads(nWorkers)
+    for (int i = 0; i < nPages; ++i)
     {
-        if (!start && coord[i] == 1)
+        PageImage page(pages[i], scale);
+        if (page.layoutImage().empty())
         {
-            result.push_back(i);
-            start = true;
+            qWarning() << "ERROR : " << pages[i] << " can not be read!";
+            continue;
         }
-
-        else if(start && coord[i] == 0)
+        try
         {
-            result.push_back(i);
-            start = false;
+            layouts[i] = page.layout();
+        }
+        catch (cv::Exception &e)
+        {
+            qWarning() << "ERROR : " << pages[i] << " can not be segmented " << e.what();
+        }
+    }
+    QFile output(outFile);
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "TextRegionDetector::detectRegionsBatch failed to open file! \n";
+        return false;
+    }
+    auto writeRects = [&output](const QVector<QRect> &rects)
+    {
+        output.write(" " + QByteArray::number(rects.size()));
+        for (const QRect &rect : rects)
+        {
+            output.write(" " + QByteArray::number(rect.x()));
+            output.write(" " + QByteArray::number(rect.y()));
+            output.write(" " + QByteArray::number(rect.width()));
+            output.write(" " + QByteArray::number(rect.height()));
         }
+    };
+    for (int i = 0; i < nPages; ++i)
+    {
+        output.write(pages[i].toUtf8() + "\t");
+        writeRects(layouts[i].m_lines);
+        writeRects(layouts[i].m_words);
+        output.write("\n");
     }
+    output.close();
+    return true;
+}
 
-    if(start)
-        result.push_back(range);
 
+QVector<int> TextRegionDetector::extractCoordinateFrom(QVector<int> coord, int scale)
+{
+    int range = coord.size();
+    // runs of ones, gaps shorter than 15 are merged
+    QVector<int> result = ProjectionProfile::runs(coord, scaled(15, scale));
+    //add dumy
+    result.push_front(0);
     //add dumy
     result.push_back(range);
     // artificial dilation
-    int size = 15;
+    int size = scaled(15, scale);
+    int margin = scaled(5, scale);
 
     for (int i = 1; i < result.size() - 1; i += 2)
     {
         //        int size = result[i+1] - result[i];
-        if(result[i - 1] > (result[i] - size - 5))
-            result[i] = result[i - 1] + 5;
+        if(result[i - 1] > (result[i] - size - margin))
+            result[i] = result[i - 1] + margin;
 
         else
             result[i] -= size;
@@ -226,7 +274,7 @@ QVector<int> TextRegionDetector::extractCoordinateFrom(QVector<int> coord)
         {
             if((result[i + 1] + j) == (result[i + 2] - j))
             {
-                result[i + 1] += (j - 5);
+                result[i + 1] += (j - margin);
                 break;
             }
 
@@ -243,27 +291,20 @@ QVector<int> TextRegionDetector::extractCoordinateFrom(QVector<int> coord)
     return result;
 }
 
-void TextRegionDetector::getRange(const cv::Mat &img_bw, int &leftMargin,
-                                  int &rightMargin, QWidget *parent)
+void TextRegionDetector::getRange(const ProjectionProfile &profile, int &leftMargin,
+                                  int &rightMargin, int scale)
 {
-    cv::Mat region;
+    cv::Mat region = profile.colProfile(0, profile.rows(), 0, profile.cols());
     float meanVal;
-
-    for (int i = 0; i < img_bw.cols; ++i)
-    {
-        int tmp = cv::sum(img_bw.col(i))[0];
-        region.push_back(tmp);
-    }
-
-    region.convertTo(region, CV_32FC1);
     double minVals, maxVals;
     cv::minMaxLoc(region, &minVals, &maxVals);
     region = region / maxVals;
     // filter
-    cv::GaussianBlur(region, region, cv::Size(41, 41), 0, 0);
+    int ksize = scaledKernel(41, scale);
+    cv::GaussianBlur(region, region, cv::Size(ksize, ksize), 0, 0);
     //    Util::plot(tmp,parent);
     // calculate mean
-    meanVal = cv::mean(region(cv::Range(1000, 1800), cv::Range::all()))[0];
+    meanVal = cv::mean(region(cv::Range(1000 / scale, 1800 / scale), cv::Range::all()))[0];
 
     // binarize
     for (int i = 0; i < region.rows; ++i)
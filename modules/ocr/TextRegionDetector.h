@@ -2,18 +2,36 @@
 #define CPV_TRDETECTOR
 
 #include <opencv2/core.hpp>
-#include <QDialog>
 #include "Util.h"
+#include "ocr/ProjectionProfile.h"
+
+// only passed through for debug plots, the detector itself needs no widgets
+class QWidget;
+
+struct PageLayout
+{
+    QVector<QRect> m_lines;
+    QVector<QRect> m_words;
+};
 
 class TextRegionDetector
 {
   public:
-    static QVector<QRect> detectRegions(const cv::Mat &img_bw, QWidget *parent);
+    static QVector<QRect> detectRegions(const cv::Mat &img_bw, QWidget *parent = nullptr);
     static QVector<QRect> detectWordsFromLine(cv::Mat &lineImg, QWidget *parent);
+    // headless page segmentation : line and word rectangles of a binarized page,
+    // scale > 1 when the page was decoded at 1/scale of its full resolution,
+    // rectangles are always returned in full resolution coordinates
+    static PageLayout analyzePage(const cv::Mat &img_bw, int scale = 1);
+    // grayscale page -> inverted Otsu binarization expected by analyzePage
+    static cv::Mat binarizePage(const cv::Mat &img_gray);
+    // segments all pages concurrently and writes every rectangle to outFile
+    static bool detectRegionsBatch(const QStringList &pages, const QString &outFile,
+                                   int nWorkers = 0, int scale = 1);
   private:
-    static QVector<int> extractCoordinateFrom(QVector<int> y);
-    static void getRange(const cv::Mat &img_bw, int &leftMargin, int &rightMargin,
-                         QWidget *parent);
+    static QVector<int> extractCoordinateFrom(QVector<int> y, int scale = 1);
+    static void getRange(const ProjectionProfile &profile, int &leftMargin, int &rightMargin,
+                         int scale);
     static void extractROI(cv::Mat &regHist, int &leftMargin, int &rightMargin);
 };
 
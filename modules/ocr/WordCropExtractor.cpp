@@ -0,0 +1,133 @@
+#include "precompiled.h"
+
+#include "ocr/WordCropExtractor.h"
+#include "ocr/PageImage.h"
+
+WordCropExtractor::WordCropExtractor(const QString &saveDir, bool saveOtsu,
+                                     int writerWorkers, int queueCapacity)
+    : m_saveDir(saveDir), m_saveOtsu(saveOtsu), m_queue(queueCapacity), m_failed(0)
+{
+    if (writerWorkers < 1)
+        writerWorkers = 1;
+    for (int i = 0; i < writerWorkers; ++i)
+        m_writers.emplace_back([this]()
+        {
+            WriteJob job;
+            while (m_queue.dequeue(job))
+            {
+                if (!cv::imwrite(job.m_path.toStdString(), job.m_image))
+                {
+                    qWarning() << "ERROR : " << job.m_path << " can not be saved!" ;
+                    ++m_failed;
+                }
+                // drop the reference to the page as soon as possible
+                job.m_image.release();
+            }
+        });
+}
+
+WordCropExtractor::~WordCropExtractor()
+{
+    finish();
+}
+
+int WordCropExtractor::finish()
+{
+    m_queue.close();
+    for (auto &writer : m_writers)
+        writer.join();
+    m_writers.clear();
+    return m_failed;
+}
+
+bool WordCropExtractor::ensureDir(const QString &dir)
+{
+    QMutexLocker locker(&m_dirMutex);
+    if (m_dirs.contains(dir))
+        return true;
+    QDir qdir(dir);
+    if (!qdir.exists())
+    {
+        qdir.mkpath(".");
+        if (!qdir.exists())
+        {
+            qWarning() << "ERROR : " << qdir << " can not be created!" ;
+            return false;
+        }
+    }
+    m_dirs.insert(dir);
+    return true;
+}
+
+void WordCropExtractor::write(const QString &path, const cv::Mat &image)
+{
+    if (!m_queue.enqueue({path, image}))
+    {
+        qWarning() << "ERROR : " << path << " can not be saved, the extractor is finished!" ;
+        ++m_failed;
+    }
+}
+
+QRect WordCropExtractor::boundingRect(const QString &points)
+{
+    QPolygon poly;
+    for (const QString &pointStr : points.split(" ", QString::SkipEmptyParts))
+    {
+        QStringList pointCoords = pointStr.split(",");
+        if (pointCoords.size() < 2)
+            continue;
+        poly << QPoint(pointCoords[0].trimmed().toInt(), pointCoords[1].trimmed().toInt());
+    }
+    return poly.boundingRect();
+}
+
+void WordCropExtractor::addPage(const QString &filename, const std::vector<QString> &words,
+                                const std::vector<QString> &coords)
+{
+    // decoded on the first crop, pages without words are never decoded
+    PageImage image(filename + ".jpg");
+    QString fileNameWithoutExt = QFileInfo(filename).fileName();
+    int size = std::min(words.size(), coords.size());
+    for (int j = 0; j < size; ++j)
+    {
+        //each word represents a directory name
+        QString wordDir = m_saveDir + "/" + words[j];
+        if (!ensureDir(wordDir))
+            continue;
+        QRect rect = boundingRect(coords[j]);
+        cv::Mat im_gray = image.crop(rect);
+        if (im_gray.empty())
+        {
+            qWarning() << "ERROR : " << rect << " is outside of " << filename;
+            continue;
+        }
+        QString cropName = "/" + fileNameWithoutExt + QString::number(j) + ".jpg";
+        if (m_saveOtsu)
+        {
+            QString otsuDir = m_saveDir + "_otsu/" + words[j];
+            if (ensureDir(otsuDir))
+            {
+                cv::Mat img_bw;
+                cv::threshold(im_gray, img_bw, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
+                write(otsuDir + cropName, img_bw);
+            }
+        }
+        // the view keeps the decoded page alive until it is written
+        write(wordDir + cropName, im_gray);
+    }
+}
+
+void WordCropExtractor::extract(const QStringList &filenames, const std::vector<PageWords> &pages,
+                                int nThreads)
+{
+    if (nThreads <= 0)
+        nThreads = QThread::idealThreadCount();
+    int nPages = std::min(filenames.size(), (int)pages.size());
+    #pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+    for (int i = 0; i < nPages; ++i)
+    {
+        qDebug() << "Scanning " << (filenames[i] + ".jpg");
+        qDebug() << "Number of words :" << pages[i].m_words.size();
+        addPage(filenames[i], pages[i].m_words, pages[i].m_coords);
+    }
+}
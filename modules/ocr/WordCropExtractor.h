@@ -0,0 +1,64 @@
+#ifndef CPV_WORD_CROP_EXTRACTOR
+#define CPV_WORD_CROP_EXTRACTOR
+
+#include <opencv2/core.hpp>
+#include <QMutex>
+#include <QRect>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "BlockingQueue.h"
+#include "ocr/PageParser.h"
+
+// Cuts the word polygons of PAGE annotated pages into saveDir/<word>/ images.
+// Every page is decoded once in grayscale and its words are ROI views into it;
+// encoding and writing is done by a pool of writer threads fed through a
+// bounded queue, so page decoding never waits on the disk.
+// With saveOtsu the binarized crops are written to saveDir_otsu/<word>/ as well.
+class WordCropExtractor
+{
+  public:
+    WordCropExtractor(const QString &saveDir, bool saveOtsu = false, int writerWorkers = 2,
+                      int queueCapacity = 64);
+    // waits for the pending writes
+    ~WordCropExtractor();
+
+    // crops one page, filename is given without extension ("<name>.jpg" is
+    // decoded), safe to call from several threads
+    void addPage(const QString &filename, const std::vector<QString> &words,
+                 const std::vector<QString> &coords);
+    // crops all pages concurrently, pages[i] belongs to filenames[i]
+    void extract(const QStringList &filenames, const std::vector<PageWords> &pages,
+                 int nThreads = 0);
+    // closes the queue and joins the writers, returns the number of crops
+    // that could not be written
+    int finish();
+
+    // bounding box of "x,y x,y ..." polygon points
+    static QRect boundingRect(const QString &points);
+
+  private:
+    struct WriteJob
+    {
+        QString m_path;
+        cv::Mat m_image;
+    };
+
+    bool ensureDir(const QString &dir);
+    // a write queued after finish() is counted as failed
+    void write(const QString &path, const cv::Mat &image);
+
+    QString m_saveDir;
+    bool m_saveOtsu;
+    BlockingQueue<WriteJob> m_queue;
+    std::vector<std::thread> m_writers;
+    QMutex m_dirMutex;
+    QSet<QString> m_dirs;          // directories known to exist
+    std::atomic<int> m_failed;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "precompiled.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "ocr/WordIndex.h"
+
+// bumped whenever the saved index layout changes
+static const quint32 INDEX_VERSION = 1;
+
+bool WordIndex::build(const QString &formattedOutputFile)
+{
+    clear();
+    QFile input(formattedOutputFile);
+    if(!input.open(QIODevice::ReadOnly))
+    {
+        std::cout << "WordIndex::build failed to open file! \n";
+        return false;
+    }
+    while (!input.atEnd())
+    {
+        QString line = QString(input.readLine()).trimmed();
+        QStringList myStringList = line.split(' ');
+        if(myStringList.size() < 3)
+            continue;
+        QString word = myStringList[0];
+        int termId = m_termIds.value(word, -1);
+        if(termId < 0)
+        {
+            termId = m_terms.size();
+            m_terms.push_back(word);
+            m_termIds.insert(word, termId);
+            m_postings.push_back(std::vector<int>());
+            insertTerm(termId);
+        }
+        WordRecord rec;
+        rec.m_termId = termId;
+        rec.m_lineId = myStringList[2].split(':')[0].toInt();
+        rec.m_conf = myStringList[1].toFloat();
+        rec.m_confBox = myStringList[1] + " " + myStringList[2];
+        m_postings[termId].push_back(m_records.size());
+        m_records.push_back(rec);
+    }
+    input.close();
+    for(auto &posting : m_postings)
+        std::stable_sort(posting.begin(), posting.end(), [this](int a, int b)
+        {
+            return m_records[a].m_lineId < m_records[b].m_lineId;
+        });
+    return true;
+}
+
+bool WordIndex::save(const QString &indexFile, const QString &formattedOutputFile) const
+{
+    QFileInfo source(formattedOutputFile);
+    QSaveFile output(indexFile);
+    if(!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "WordIndex::save failed to open file! \n";
+        return false;
+    }
+    QDataStream out(&output);
+    out << INDEX_VERSION << source.size() << source.lastModified().toMSecsSinceEpoch();
+    out << (qint32)m_terms.size();
+    for(size_t t = 0; t < m_terms.size(); ++t)
+    {
+        out << m_terms[t] << (qint32)m_postings[t].size();
+        for(int rec : m_postings[t])
+            out << (qint32)rec;
+    }
+    out << (qint32)m_records.size();
+    for(const WordRecord &rec : m_records)
+        out << (qint32)rec.m_termId << (qint32)rec.m_lineId << rec.m_conf << rec.m_confBox;
+    out << (qint32)m_bkTree.size();
+    for(const BKNode &node : m_bkTree)
+    {
+        out << (qint32)node.m_termId << (qint32)node.m_children.size();
+        for(const auto &child : node.m_children)
+            out << (qint32)child.first << (qint32)child.second;
+    }
+    return out.status() == QDataStream::Ok && output.commit();
+}
+
+bool WordIndex::load(const QString &indexFile, const QString &formattedOutputFile)
+{
+    clear();
+    QFile input(indexFile);
+    if(!input.open(QIODevice::ReadOnly))
+        return false;
+    QFileInfo source(formattedOutputFile);
+    QDataStream in(&input);
+    quint32 version;
+    qint64 size, mtime;
+    in >> version >> size >> mtime;
+    if(version != INDEX_VERSION || !source.exists() || size != source.size()
+            || mtime != source.lastModified().toMSecsSinceEpoch())
+        return false;
+    // counts are bounded by what the rest of the file can hold before anything
+    // is allocated, ids are checked before anything dereferences them, so a
+    // truncated or corrupt index is rebuilt instead of trusted
+    auto fits = [&](qint32 count, qint64 minBytes)
+    {
+        return in.status() == QDataStream::Ok && count >= 0
+               && count <= (input.size() - input.pos()) / minBytes;
+    };
+    auto fail = [this]()
+    {
+        clear();
+        return false;
+    };
+    qint32 nTerms, nRecords, nNodes, n, a, b;
+    in >> nTerms;
+    // a term is at least its string length and posting count
+    if(!fits(nTerms, 8))
+        return fail();
+    m_terms.resize(nTerms);
+    m_postings.resize(nTerms);
+    for(int t = 0; t < nTerms; ++t)
+    {
+        in >> m_terms[t] >> n;
+        if(!fits(n, 4))
+            return fail();
+        m_termIds.insert(m_terms[t], t);
+        m_postings[t].resize(n);
+        for(int i = 0; i < n; ++i)
+        {
+            in >> a;
+            m_postings[t][i] = a;
+        }
+    }
+    in >> nRecords;
+    // term id, line id, conf and the length of the box string
+    if(!fits(nRecords, 16))
+        return fail();
+    m_records.resize(nRecords);
+    for(WordRecord &rec : m_records)
+    {
+        in >> rec.m_termId >> rec.m_lineId >> rec.m_conf >> rec.m_confBox;
+        if(rec.m_termId < 0 || rec.m_termId >= nTerms)
+            return fail();
+    }
+    in >> nNodes;
+    // one node per term
+    if(nNodes != nTerms || !fits(nNodes, 8))
+        return fail();
+    m_bkTree.resize(nNodes);
+    for(int k = 0; k < nNodes; ++k)
+    {
+        BKNode &node = m_bkTree[k];
+        in >> node.m_termId >> n;
+        if(node.m_termId < 0 || node.m_termId >= nTerms || !fits(n, 8))
+            return fail();
+        node.m_children.resize(n);
+        for(int i = 0; i < n; ++i)
+        {
+            in >> a >> b;
+            // children are always appended after their parent, which also
+            // rules out cycles
+            if(b <= k || b >= nNodes)
+                return fail();
+            node.m_children[i] = std::make_pair(a, b);
+        }
+    }
+    if(in.status() != QDataStream::Ok)
+        return fail();
+    for(const auto &posting : m_postings)
+        for(int rec : posting)
+            if(rec < 0 || rec >= nRecords)
+                return fail();
+    return true;
+}
+
+void WordIndex::clear()
+{
+    m_records.clear();
+    m_terms.clear();
+    m_termIds.clear();
+    m_postings.clear();
+    m_bkTree.clear();
+}
+
+void WordIndex::insertTerm(int termId)
+{
+    BKNode node;
+    node.m_termId = termId;
+    if(m_bkTree.empty())
+    {
+        m_bkTree.push_back(node);
+        return;
+    }
+    int cur = 0;
+    while(true)
+    {
+        int dist = editDistance(m_terms[termId], m_terms[m_bkTree[cur].m_termId]);
+        auto &children = m_bkTree[cur].m_children;
+        auto it = std::find_if(children.begin(), children.end(),
+                               [dist](const std::pair<int, int> &c) { return c.first == dist; });
+        if(it == children.end())
+        {
+            children.push_back(std::make_pair(dist, (int)m_bkTree.size()));
+            m_bkTree.push_back(node);
+            return;
+        }
+        cur = it->second;
+    }
+}
+
+std::vector<WordMatch> WordIndex::fuzzyFind(const QString &term, int maxDistance) const
+{
+    std::vector<WordMatch> result;
+    if(m_bkTree.empty())
+        return result;
+    std::vector<int> stack(1, 0);
+    while(!stack.empty())
+    {
+        const BKNode &node = m_bkTree[stack.back()];
+        stack.pop_back();
+        int dist = editDistance(term, m_terms[node.m_termId]);
+        if(dist <= maxDistance)
+            for(int rec : m_postings[node.m_termId])
+                result.push_back({rec, dist});
+        // triangle inequality : only children in [dist - k, dist + k] can match
+        for(const auto &child : node.m_children)
+            if(child.first >= dist - maxDistance && child.first <= dist + maxDistance)
+                stack.push_back(child.second);
+    }
+    std::sort(result.begin(), result.end(), [this](const WordMatch &a, const WordMatch &b)
+    {
+        if(a.m_distance != b.m_distance)
+            return a.m_distance < b.m_distance;
+        return m_records[a.m_record].m_conf > m_records[b.m_record].m_conf;
+    });
+    return result;
+}
+
+const std::vector<int> &WordIndex::postings(const QString &term) const
+{
+    static const std::vector<int> empty;
+    int termId = m_termIds.value(term, -1);
+    return termId < 0 ? empty : m_postings[termId];
+}
+
+std::vector<SegmentRange> WordIndex::segmentsOf(const QString &term) const
+{
+    std::vector<SegmentRange> segments;
+    for(int rec : postings(term))
+    {
+        // a word on line L is inside the windows of segments L - 5 ... L
+        int lineId = m_records[rec].m_lineId;
+        int first = std::max(1, lineId - SEGMENT_LINES + 1);
+        if(!segments.empty() && first <= segments.back().second + 1)
+            segments.back().second = std::max(segments.back().second, lineId);
+        else
+            segments.push_back(SegmentRange(first, lineId));
+    }
+    return segments;
+}
+
+std::vector<SegmentRange> WordIndex::intersect(const std::vector<SegmentRange> &a,
+                                               const std::vector<SegmentRange> &b)
+{
+    std::vector<SegmentRange> result;
+    size_t i = 0, j = 0;
+    while(i < a.size() && j < b.size())
+    {
+        int lo = std::max(a[i].first, b[j].first);
+        int hi = std::min(a[i].second, b[j].second);
+        if(lo <= hi)
+            result.push_back(SegmentRange(lo, hi));
+        if(a[i].second < b[j].second)
+            ++i;
+        else
+            ++j;
+    }
+    return result;
+}
+
+int WordIndex::editDistance(const QString &a, const QString &b)
+{
+    int n = a.length();
+    int m = b.length();
+    std::vector<int> prev(m + 1), cur(m + 1);
+    for(int j = 0; j <= m; ++j)
+        prev[j] = j;
+    for(int i = 1; i <= n; ++i)
+    {
+        cur[0] = i;
+        for(int j = 1; j <= m; ++j)
+        {
+            int subst = prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+            cur[j] = std::min(subst, std::min(prev[j], cur[j - 1]) + 1);
+        }
+        std::swap(prev, cur);
+    }
+    return prev[m];
+}
@@ -0,0 +1,86 @@
+#ifndef CPV_WORD_INDEX
+#define CPV_WORD_INDEX
+
+#include <QString>
+#include <QHash>
+#include <vector>
+
+// number of consecutive lines forming one retrieval segment
+#define SEGMENT_LINES 6
+
+// one recognized word as written to formatted_output.txt :
+// "word conf lineId:WxH+X+Y"
+struct WordRecord
+{
+    int m_termId;
+    int m_lineId;
+    float m_conf;
+    QString m_confBox;   // "conf lineId:WxH+X+Y", reused verbatim in search results
+};
+
+// closed range of segment numbers
+using SegmentRange = std::pair<int, int>;
+
+struct WordMatch
+{
+    int m_record;
+    int m_distance;
+};
+
+// Term dictionary over the recognition output with a BK-tree on top of it.
+// Approximate lookups only touch the part of the dictionary that can be within
+// the requested edit distance; postings then expand terms to their occurrences.
+class WordIndex
+{
+  public:
+    bool build(const QString &formattedOutputFile);
+    // the index together with the size and mtime of the output it was built
+    // from; load fails if that file changed since
+    bool save(const QString &indexFile, const QString &formattedOutputFile) const;
+    bool load(const QString &indexFile, const QString &formattedOutputFile);
+    void clear();
+    inline bool isEmpty() const
+    {
+        return m_records.empty();
+    }
+
+    // all occurrences of terms within maxDistance edits of term, ranked by
+    // edit distance and then by recognition confidence
+    std::vector<WordMatch> fuzzyFind(const QString &term, int maxDistance) const;
+    // occurrences of exactly term, ordered by line id
+    const std::vector<int> &postings(const QString &term) const;
+    // sorted, disjoint segment ranges whose SEGMENT_LINES window holds term
+    std::vector<SegmentRange> segmentsOf(const QString &term) const;
+
+    // merge join of two sorted, disjoint range lists
+    static std::vector<SegmentRange> intersect(const std::vector<SegmentRange> &a,
+                                               const std::vector<SegmentRange> &b);
+
+    inline const WordRecord &record(int index) const
+    {
+        return m_records[index];
+    }
+    inline int termCount() const
+    {
+        return m_terms.size();
+    }
+
+    static int editDistance(const QString &a, const QString &b);
+
+  private:
+    struct BKNode
+    {
+        int m_termId;
+        std::vector<std::pair<int, int>> m_children;   // (distance, node index)
+    };
+
+    void insertTerm(int termId);
+
+    std::vector<WordRecord> m_records;
+    std::vector<QString> m_terms;
+    QHash<QString, int> m_termIds;
+    std::vector<std::vector<int>> m_postings;          // term id -> record indices
+    std::vector<BKNode> m_bkTree;
+};
+
+#endif
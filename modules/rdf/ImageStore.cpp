@@ -0,0 +1,204 @@
+#include "precompiled.h"
+
+#include <atomic>
+
+#include "rdf/ImageStore.h"
+#include "rdf/PackedDataSet.h"
+#include "BulkFileReader.h"
+
+ImageStore::ImageStore(qint64 budget) : m_budget(std::make_shared<Budget>())
+{
+    m_budget->m_limit = budget;
+}
+
+ImageStore::~ImageStore()
+{
+    m_budget->m_used -= m_bytesInUse;
+}
+
+void ImageStore::setPadding(int padX, int padY)
+{
+    m_padX = padX;
+    m_padY = padY;
+}
+
+void ImageStore::setBudget(qint64 budget)
+{
+    QMutexLocker locker(&m_mutex);
+    m_budget->m_limit = budget;
+    evict();
+}
+
+void ImageStore::shareBudget(const ImageStore &other)
+{
+    QMutexLocker locker(&m_mutex);
+    m_budget->m_used -= m_bytesInUse;
+    m_budget = other.m_budget;
+    m_budget->m_used += m_bytesInUse;
+    evict();
+}
+
+bool ImageStore::overBudget(qint64 bytes) const
+{
+    qint64 limit = m_budget->m_limit;
+    return limit > 0 && m_budget->m_used + bytes > limit;
+}
+
+qint64 ImageStore::bytesInUse() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytesInUse;
+}
+
+void ImageStore::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+    m_budget->m_used -= m_bytesInUse;
+    m_bytesInUse = 0;
+    m_packed.reset();
+}
+
+void ImageStore::addFiles(const std::vector<QString> &paths)
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.reserve(m_entries.size() + paths.size());
+    for (const QString &path : paths)
+    {
+        Entry e;
+        e.m_path = path;
+        m_entries.push_back(e);
+    }
+}
+
+void ImageStore::addPacked(const std::shared_ptr<PackedDataSet> &packed)
+{
+    QMutexLocker locker(&m_mutex);
+    m_packed = packed;
+    m_entries.reserve(m_entries.size() + packed->size());
+    for (int i = 0; i < packed->size(); ++i)
+    {
+        // a view onto the mapping, never evicted
+        Entry e;
+        e.m_image = packed->image(i);
+        e.m_cached = true;
+        m_entries.push_back(e);
+    }
+}
+
+cv::Mat ImageStore::image(int i) const
+{
+    QString path;
+    {
+        QMutexLocker locker(&m_mutex);
+        Entry &e = m_entries[i];
+        if (e.m_cached)
+        {
+            if (e.m_bytes > 0)
+                m_lru.splice(m_lru.begin(), m_lru, e.m_lru);
+            return e.m_image;
+        }
+        path = e.m_path;
+    }
+    // decode without holding the lock, other threads keep hitting the cache
+    cv::Mat image = decode(path);
+    QMutexLocker locker(&m_mutex);
+    Entry &e = m_entries[i];
+    // another thread got there first
+    if (e.m_cached)
+        return e.m_image;
+    if (!image.empty())
+        insert(i, image);
+    return image;
+}
+
+void ImageStore::preload(int n, int nThreads)
+{
+    if (n <= 0 || n > size())
+        n = size();
+    std::vector<int> indices;
+    std::vector<QString> paths;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < n; ++i)
+        {
+            if (m_entries[i].m_cached)
+                continue;
+            indices.push_back(i);
+            paths.push_back(m_entries[i].m_path);
+        }
+    }
+    // once an image does not fit the rest is left to image()
+    std::atomic<bool> full(false);
+    BulkFileReader reader(BulkFileReader::DEFAULT_QUEUE_DEPTH, nThreads);
+    reader.read(paths, [&](int k, std::vector<uchar> &bytes)
+    {
+        if (full)
+            return;
+        cv::Mat image;
+        if (!bytes.empty())
+            image = cv::imdecode(bytes, CV_LOAD_IMAGE_GRAYSCALE);
+        if (image.empty())
+        {
+            qWarning() << "ERROR : could not read " << paths[k];
+            return;
+        }
+        cv::copyMakeBorder(image, image, m_padY, m_padY, m_padX, m_padX, cv::BORDER_CONSTANT);
+        QMutexLocker locker(&m_mutex);
+        qint64 bytesNeeded = image.total() * image.elemSize();
+        if (overBudget(bytesNeeded))
+        {
+            full = true;
+            return;
+        }
+        if (!m_entries[indices[k]].m_cached)
+            insert(indices[k], image);
+    });
+}
+
+cv::Mat ImageStore::decode(const QString &path) const
+{
+    cv::Mat image = cv::imread(path.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
+    if (image.empty())
+    {
+        qWarning() << "ERROR : could not read " << path;
+        return image;
+    }
+    cv::copyMakeBorder(image, image, m_padY, m_padY, m_padX, m_padX, cv::BORDER_CONSTANT);
+    return image;
+}
+
+void ImageStore::insert(int i, const cv::Mat &image) const
+{
+    qint64 bytes = image.total() * image.elemSize();
+    // once the budget is full images are handed out but not kept. The training
+    // passes scan the set in the same order every time, evicting the least
+    // recently used image would throw out the very one needed next and no
+    // image would ever be hit
+    if (overBudget(bytes))
+        return;
+    Entry &e = m_entries[i];
+    e.m_image = image;
+    e.m_bytes = bytes;
+    e.m_cached = true;
+    m_lru.push_front(i);
+    e.m_lru = m_lru.begin();
+    m_bytesInUse += bytes;
+    m_budget->m_used += bytes;
+}
+
+void ImageStore::evict() const
+{
+    // only our own images can go, those of the other stores are theirs to evict
+    while (overBudget(0) && !m_lru.empty())
+    {
+        Entry &e = m_entries[m_lru.back()];
+        m_lru.pop_back();
+        e.m_image.release();
+        e.m_cached = false;
+        m_bytesInUse -= e.m_bytes;
+        m_budget->m_used -= e.m_bytes;
+        e.m_bytes = 0;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef CPV_IMAGE_STORE
+#define CPV_IMAGE_STORE
+
+#include <opencv2/core.hpp>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <vector>
+
+class PackedDataSet;
+
+// The padded images of a data set behind a byte budget. Images come either
+// from files, decoded and padded on first use and kept while the budget has
+// room, or from a PackedDataSet, whose views cost nothing here since the page
+// cache holds them. Images that no longer fit are decoded on every use, the
+// ones already kept stay, so a scan over a set larger than the budget hits the
+// fraction that fits; lowering the budget evicts least recently used first. image() hands out cv::Mat
+// references to the shared buffer, so an image evicted while a caller still
+// uses it stays valid until that caller lets it go.
+// Several stores can share one budget, each then only evicts its own images.
+class ImageStore
+{
+  public:
+    // budget in bytes, 0 for no limit
+    explicit ImageStore(qint64 budget = 0);
+    ~ImageStore();
+
+    void setPadding(int padX, int padY);
+    // changes the limit of every store sharing the budget
+    void setBudget(qint64 budget);
+    inline qint64 budget() const
+    {
+        return m_budget->m_limit;
+    }
+    // from now on images of this store count against other's budget as well
+    void shareBudget(const ImageStore &other);
+    // bytes of decoded images held by the store
+    qint64 bytesInUse() const;
+
+    void clear();
+    void addFiles(const std::vector<QString> &paths);
+    void addPacked(const std::shared_ptr<PackedDataSet> &packed);
+    inline int size() const
+    {
+        return m_entries.size();
+    }
+    inline bool isPacked() const
+    {
+        return m_packed != nullptr;
+    }
+
+    // thread safe, empty if the image could not be read
+    cv::Mat image(int i) const;
+    // decodes images [0, n) ahead of use with BulkFileReader until the budget
+    // is full, n <= 0 for all of them
+    void preload(int n = 0, int nThreads = 0);
+
+  private:
+    struct Budget
+    {
+        std::atomic<qint64> m_limit{0};
+        // bytes held by all stores sharing the budget
+        std::atomic<qint64> m_used{0};
+    };
+
+    struct Entry
+    {
+        QString m_path;
+        cv::Mat m_image;
+        qint64 m_bytes = 0;
+        bool m_cached = false;
+        std::list<int>::iterator m_lru;
+    };
+
+    cv::Mat decode(const QString &path) const;
+    // whether bytes more would exceed the budget, called with m_mutex held
+    bool overBudget(qint64 bytes) const;
+    // takes the store's reference on image i if it fits the budget, called
+    // with m_mutex held
+    void insert(int i, const cv::Mat &image) const;
+    void evict() const;
+
+    mutable QMutex m_mutex;
+    mutable std::vector<Entry> m_entries;
+    // most recently used first, decoded file entries only
+    mutable std::list<int> m_lru;
+    mutable qint64 m_bytesInUse = 0;
+    std::shared_ptr<Budget> m_budget;
+    int m_padX = 0;
+    int m_padY = 0;
+    std::shared_ptr<PackedDataSet> m_packed;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "precompiled.h"
+
+#include <iostream>
+
+#include "rdf/PackedDataSet.h"
+#include "ocr/Reader.h"
+#include "BulkFileReader.h"
+
+static const quint32 PACK_MAGIC = 0x4B415043;   // "CPAK"
+// bumped whenever the file layout changes
+static const quint32 PACK_VERSION = 1;
+// the image block starts on this boundary, the header fits in front of it
+static const qint64 PACK_ALIGNMENT = 4096;
+// images read and decoded together before being appended to the file
+static const int PACK_BATCH = 256;
+
+PackedDataSet::~PackedDataSet()
+{
+    close();
+}
+
+bool PackedDataSet::build(const QString &dir, const QString &packFile, int padX, int padY,
+                          int nThreads)
+{
+    std::vector<QString> fNames;
+    std::vector<QString> labels;
+    Reader reader;
+    reader.findImages(dir, "", fNames, labels);
+    QSaveFile out(packFile);
+    if (!out.open(QIODevice::WriteOnly))
+    {
+        std::cout << "PackedDataSet::build failed to open file! \n";
+        return false;
+    }
+    BulkFileReader bulkReader(BulkFileReader::DEFAULT_QUEUE_DEPTH, nThreads);
+    std::vector<Entry> entries;
+    entries.reserve(fNames.size());
+    out.write(QByteArray((int)PACK_ALIGNMENT, 0));
+    qint64 offset = 0;
+    int nImages = fNames.size();
+    std::vector<cv::Mat> batch;
+    for (int first = 0; first < nImages; first += PACK_BATCH)
+    {
+        int last = std::min(nImages, first + PACK_BATCH);
+        batch.assign(last - first, cv::Mat());
+        std::vector<QString> batchNames(fNames.begin() + first, fNames.begin() + last);
+        bulkReader.read(batchNames, [&](int i, std::vector<uchar> &bytes)
+        {
+            if (bytes.empty())
+                return;
+            cv::Mat image = cv::imdecode(bytes, CV_LOAD_IMAGE_GRAYSCALE);
+            if (!image.empty())
+                cv::copyMakeBorder(image, batch[i], padY, padY, padX, padX, cv::BORDER_CONSTANT);
+        });
+        for (int i = first; i < last; ++i)
+        {
+            const cv::Mat &image = batch[i - first];
+            if (image.empty())
+            {
+                qWarning() << "ERROR : could not read " << fNames[i];
+                continue;
+            }
+            // copyMakeBorder output is continuous
+            qint64 nBytes = (qint64)image.rows * image.cols;
+            if (out.write((const char *)image.data, nBytes) != nBytes)
+            {
+                std::cout << "PackedDataSet::build failed to write file! \n";
+                out.cancelWriting();
+                return false;
+            }
+            entries.push_back({offset, image.rows, image.cols, labels[i]});
+            offset += nBytes;
+        }
+    }
+    qint64 indexOffset = PACK_ALIGNMENT + offset;
+    QDataStream stream(&out);
+    for (const Entry &e : entries)
+        stream << e.m_offset << e.m_rows << e.m_cols << e.m_label;
+    out.seek(0);
+    stream << PACK_MAGIC << PACK_VERSION << (qint32)padX << (qint32)padY
+           << (qint32)entries.size() << PACK_ALIGNMENT << indexOffset;
+    if (stream.status() != QDataStream::Ok || !out.commit())
+    {
+        std::cout << "PackedDataSet::build failed to write file! \n";
+        return false;
+    }
+    qDebug() << "Packed " << entries.size() << " images into " << packFile;
+    return true;
+}
+
+bool PackedDataSet::open(const QString &packFile)
+{
+    close();
+    m_file.setFileName(packFile);
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        std::cout << "PackedDataSet::open failed to open file! \n";
+        return false;
+    }
+    QDataStream header(&m_file);
+    quint32 magic, version;
+    qint32 count;
+    qint64 dataOffset, indexOffset;
+    header >> magic >> version >> m_padX >> m_padY >> count >> dataOffset >> indexOffset;
+    if (header.status() != QDataStream::Ok || magic != PACK_MAGIC || version != PACK_VERSION
+            || count < 0 || dataOffset < 0 || indexOffset < dataOffset
+            || indexOffset > m_file.size())
+    {
+        qWarning() << "ERROR : not a packed data set " << packFile;
+        close();
+        return false;
+    }
+    // the index is read once, images stay on disk until they are touched.
+    // An entry takes at least 20 bytes (offset, rows, cols, label length), so
+    // a corrupt count can not make us allocate more than the file holds, and
+    // every image must lie inside the data block that gets mapped
+    m_file.seek(indexOffset);
+    QDataStream index(&m_file);
+    qint64 dataSize = indexOffset - dataOffset;
+    bool valid = count <= (m_file.size() - indexOffset) / 20;
+    if (valid)
+        m_entries.resize(count);
+    for (size_t i = 0; valid && i < m_entries.size(); ++i)
+    {
+        Entry &e = m_entries[i];
+        index >> e.m_offset >> e.m_rows >> e.m_cols >> e.m_label;
+        valid = index.status() == QDataStream::Ok && e.m_offset >= 0 && e.m_rows >= 0
+                && e.m_cols >= 0 && e.m_offset + (qint64)e.m_rows * e.m_cols <= dataSize;
+    }
+    if (!valid || index.status() != QDataStream::Ok)
+    {
+        qWarning() << "ERROR : corrupt index in " << packFile;
+        close();
+        return false;
+    }
+    // private mapping : a stray write to an image never reaches the file
+    if (indexOffset > dataOffset)
+    {
+        m_data = m_file.map(dataOffset, indexOffset - dataOffset, QFileDevice::MapPrivateOption);
+        if (!m_data)
+        {
+            qWarning() << "ERROR : could not map " << packFile;
+            close();
+            return false;
+        }
+    }
+    else
+    {
+        // nothing to map, keep isOpen() meaningful for an empty set
+        static uchar empty;
+        m_data = &empty;
+    }
+    return true;
+}
+
+void PackedDataSet::close()
+{
+    // closing the file unmaps it
+    m_file.close();
+    m_data = nullptr;
+    m_entries.clear();
+}
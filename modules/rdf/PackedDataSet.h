@@ -0,0 +1,71 @@
+#ifndef CPV_PACKED_DATA_SET
+#define CPV_PACKED_DATA_SET
+
+#include <opencv2/core.hpp>
+#include <QFile>
+#include <QString>
+#include <vector>
+
+// Training / test images packed into a single file : a header, one page
+// aligned block of raw 8-bit images stored back to back, already padded, and
+// an index of (offset, rows, cols, label) at the end. The file is memory
+// mapped copy-on-write, so images are cv::Mat headers onto the mapping, only
+// the pages that are touched are read and the page cache is shared between
+// runs.
+class PackedDataSet
+{
+  public:
+    ~PackedDataSet();
+
+    // packs every image Reader::findImages finds under dir, each one padded
+    // with padY rows and padX columns of zeros on both sides
+    static bool build(const QString &dir, const QString &packFile, int padX, int padY,
+                      int nThreads = 0);
+
+    bool open(const QString &packFile);
+    void close();
+
+    inline bool isOpen() const
+    {
+        return m_data != nullptr;
+    }
+    inline int size() const
+    {
+        return m_entries.size();
+    }
+    inline int padX() const
+    {
+        return m_padX;
+    }
+    inline int padY() const
+    {
+        return m_padY;
+    }
+    // valid while the data set is open
+    inline cv::Mat image(int i) const
+    {
+        const Entry &e = m_entries[i];
+        return cv::Mat(e.m_rows, e.m_cols, CV_8UC1, m_data + e.m_offset);
+    }
+    inline const QString &label(int i) const
+    {
+        return m_entries[i].m_label;
+    }
+
+  private:
+    struct Entry
+    {
+        qint64 m_offset;
+        qint32 m_rows;
+        qint32 m_cols;
+        QString m_label;
+    };
+
+    QFile m_file;
+    uchar *m_data = nullptr;
+    std::vector<Entry> m_entries;
+    int m_padX = 0;
+    int m_padY = 0;
+};
+
+#endif
@@ -14,6 +14,9 @@ struct RDFParams
     int minLeafPixels;
     int labelCount;
     int maxIteration;
+    // byte budget shared by the decoded train and test images together,
+    // 0 for no limit
+    qint64 imageCacheBytes = 0;
 
     template<class Archive>
     void serialize(Archive &archive)
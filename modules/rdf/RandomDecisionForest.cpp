@@ -1,10 +1,19 @@
 #include "precompiled.h"
 #include <ctime>
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <thread>
 
 #include "RandomDecisionForest.h"
 #include "ocr/Reader.h"
 #include "Util.h"
 #include "ocr/TextRegionDetector.h"
+#include "BlockingQueue.h"
+#include "BulkFileReader.h"
+#include "rdf/PackedDataSet.h"
+#include "rdf/RecognitionCache.h"
+#include "rdf/RecognitionJournal.h"
 //#include <omp.h>
 
 // histogram normalize ?
@@ -14,110 +23,368 @@
 void RandomDecisionForest::readTrainingImageFiles()
 {
     // TODO :  make applicable to both MNIST and image folders
+    m_dir = m_params.trainImagesDir;
+    if (QFileInfo(m_dir).isFile())
+    {
+        loadPackedTrainingSet(m_dir);
+        return;
+    }
     std::vector<QString> fNames;
-    auto *reader = new Reader();
-    reader->findImages(m_dir, "", fNames, m_DS.m_trainlabels);
+    Reader reader;
+    reader.findImages(m_dir, "", fNames, m_DS.m_trainlabels);
     m_numOfLetters = fNames.size();
     qDebug() << "NO OF LETTERS : " << m_numOfLetters;
-    for (auto filePath : fNames)
-    {
-        cv::Mat image = cv::imread(filePath.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
-        cv::copyMakeBorder(image, image, m_params.probDistY, m_params.probDistY,
-                           m_params.probDistX, m_params.probDistX, cv::BORDER_CONSTANT);
-        m_DS.m_trainImagesVector.push_back(image);
-    }
-    qDebug() << "No of IMAGES : " << m_DS.m_trainImagesVector.size() << " NO of Fnames" << m_numOfLetters <<
-             "Images Vector Size : " << m_DS.m_trainImagesVector.size();
+    m_DS.m_trainImages.setPadding(m_params.probDistX, m_params.probDistY);
+    m_DS.m_trainImages.setBudget(m_params.imageCacheBytes);
+    m_DS.m_trainImages.addFiles(fNames);
+    // decode what fits the budget now, the rest is decoded on first use
+    m_DS.m_trainImages.preload();
+    qDebug() << "No of IMAGES : " << m_DS.m_trainImages.size() << " NO of Fnames" << m_numOfLetters <<
+             "Decoded bytes : " << m_DS.m_trainImages.bytesInUse();
     fNames.clear();
 }
 
 void RandomDecisionForest::readTestImageFiles()
 {
     // TODO :  make applicable to both MNIST and image folders
-    m_DS.m_testImagesVector.clear();
+    m_DS.m_testImages.clear();
     m_dir = m_params.testDir;
-    std::vector<QString> fNames;
-    auto *reader = new Reader();
-    reader->findImages(m_dir, "", fNames, m_DS.m_testlabels);
-    for (auto filePath : fNames)
+    if (QFileInfo(m_dir).isFile())
     {
-        //TODO: reads file with only
-        cv::Mat image = cv::imread(filePath.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
-        //pad image and save to vector
-        cv::copyMakeBorder(image, image, m_params.probDistY, m_params.probDistY,
-                           m_params.probDistX, m_params.probDistX, cv::BORDER_CONSTANT);
-        m_DS.m_testImagesVector.push_back(image);
+        loadPackedTestSet(m_dir);
+        return;
     }
-    qDebug() << "No of test IMAGES : " << m_DS.m_testImagesVector.size();
+    std::vector<QString> fNames;
+    Reader reader;
+    reader.findImages(m_dir, "", fNames, m_DS.m_testlabels);
+    m_DS.m_testImages.setPadding(m_params.probDistX, m_params.probDistY);
+    m_DS.m_testImages.setBudget(m_params.imageCacheBytes);
+    m_DS.m_testImages.addFiles(fNames);
+    m_DS.m_testImages.preload();
+    qDebug() << "No of test IMAGES : " << m_DS.m_testImages.size();
     fNames.clear();
 }
 
-void RandomDecisionForest::readAndIdentifyWords()
+static std::shared_ptr<PackedDataSet> openPacked(const QString &packFile,
+                                                 const RDFParams &params)
+{
+    std::shared_ptr<PackedDataSet> packed(new PackedDataSet());
+    if (!packed->open(packFile))
+        return nullptr;
+    if (packed->padX() != params.probDistX || packed->padY() != params.probDistY)
+    {
+        qWarning() << "ERROR : " << packFile << " is padded by " << packed->padX() << "x"
+                   << packed->padY() << ", probe distances are " << params.probDistX << "x"
+                   << params.probDistY;
+        return nullptr;
+    }
+    return packed;
+}
+
+// images are views onto the mapping, nothing is decoded or copied up front
+bool RandomDecisionForest::loadPackedTrainingSet(const QString &packFile)
+{
+    auto packed = openPacked(packFile, m_params);
+    if (!packed)
+        return false;
+    m_DS.m_trainImages.clear();
+    m_DS.m_trainImages.addPacked(packed);
+    m_DS.m_trainlabels.clear();
+    m_DS.m_trainlabels.reserve(packed->size());
+    for (int i = 0; i < packed->size(); ++i)
+        m_DS.m_trainlabels.push_back(packed->label(i));
+    m_numOfLetters = packed->size();
+    qDebug() << "No of packed IMAGES : " << m_numOfLetters;
+    return true;
+}
+
+bool RandomDecisionForest::loadPackedTestSet(const QString &packFile)
+{
+    auto packed = openPacked(packFile, m_params);
+    if (!packed)
+        return false;
+    m_DS.m_testImages.clear();
+    m_DS.m_testImages.addPacked(packed);
+    m_DS.m_testlabels.clear();
+    m_DS.m_testlabels.reserve(packed->size());
+    for (int i = 0; i < packed->size(); ++i)
+        m_DS.m_testlabels.push_back(packed->label(i));
+    qDebug() << "No of packed test IMAGES : " << packed->size();
+    return true;
+}
+
+namespace
+{
+// one line image travelling through the readAndIdentifyWords pipeline
+struct LineJob
+{
+    int m_index = 0;
+    QString m_path;
+    int m_offsetX = 0;
+    int m_offsetY = 0;
+    cv::Mat m_image;
+    QVector<QRect> m_wordsRoi;
+    std::vector<cv::Mat_<float>> m_confidences;
+    QStringList m_words;
+    QVector<float> m_wordConfs;
+    // empty when the line is not to be cached
+    QByteArray m_cacheKey;
+    bool m_fromCache = false;
+};
+
+using LineQueue = BlockingQueue<LineJob>;
+
+// one padded test image on its way from the prefetcher to the classifier
+struct TestJob
+{
+    int m_index = 0;
+    cv::Mat m_image;
+};
+
+// starts nWorkers threads applying work to every job of in and forwarding it
+// to out, out is closed once the last of them is done
+void startStage(std::vector<std::thread> &threads, int nWorkers, LineQueue &in,
+                LineQueue &out, std::function<void(LineJob &)> work)
+{
+    nWorkers = std::max(1, nWorkers);
+    auto remaining = std::make_shared<std::atomic<int>>(nWorkers);
+    for (int i = 0; i < nWorkers; ++i)
+    {
+        threads.emplace_back([&in, &out, work, remaining]()
+        {
+            LineJob job;
+            while (in.dequeue(job))
+            {
+                work(job);
+                out.enqueue(std::move(job));
+            }
+            if (--*remaining == 0)
+                out.close();
+        });
+    }
+}
+}
+
+// Line images flow through bounded queues between the stages
+// decode -> word detection -> forest inference -> word decoding -> output,
+// each stage running its own workers (see RecognitionPipelineParams).
+// The output stage restores the input order before writing.
+void RandomDecisionForest::readAndIdentifyWords(const RecognitionShard &shard)
 {
     m_dir = m_params.testDir;
     std::vector<QString> fNames;
-    auto *reader = new Reader();
-    reader->findImages(m_dir, "", fNames, m_DS.m_testlabels);
+    Reader reader;
+    reader.findImages(m_dir, "", fNames, m_DS.m_testlabels);
+    // keep the shard's lines only
+    int firstLine = std::min<int>(std::max(0, shard.m_firstLine), fNames.size());
+    int lastLine = shard.m_lineCount < 0 ? fNames.size()
+                   : std::min<int>(firstLine + shard.m_lineCount, fNames.size());
+    fNames = std::vector<QString>(fNames.begin() + firstLine, fNames.begin() + lastLine);
     // source file for average values
-    QString lineOffsetFile = "./combined.txt";
-    QFile input(lineOffsetFile);
+    QFile input(shard.m_offsetsFile);
     if(!input.open(QIODevice::ReadOnly))
         std::cout <<
                   "RandomDecisionForest::readAndIdentifyWords failed to open file! \n";
-    QString formattedOutputFile = "./formatted_output.txt";
-    QFile output(formattedOutputFile);
-    if(!output.open(QIODevice::WriteOnly))
-        std::cout <<
-                  "RandomDecisionForest::readAndIdentifyWords failed to open file! \n";
-    auto lineNo = 0;
-    for (auto filePath : fNames)
+    // offsets are read in step with the line images
+    for (int i = 0; i < firstLine && !input.atEnd(); ++i)
+        input.readLine();
+    const RecognitionPipelineParams &pp = m_pipelineParams;
+    QByteArray modelContext = recognitionContext();
+    RecognitionCache cache(modelContext);
+    QByteArray context;
+    if(pp.useRecognitionCache)
+    {
+        cache.load();
+        context = modelContext;
+    }
+    // a run is the same when the line images and the model are
+    QCryptographicHash runHash(QCryptographicHash::Sha1);
+    for (const QString &filePath : fNames)
+        runHash.addData(filePath.toUtf8() + '\n');
+    runHash.addData(modelContext);
+    RecognitionJournal journal(shard.m_outputFile);
+    if(!journal.begin(runHash.result()))
+        return;
+    const int firstIndex = journal.nextIndex();
+    LineQueue decodeQueue(pp.queueCapacity);
+    LineQueue detectQueue(pp.queueCapacity);
+    LineQueue inferenceQueue(pp.queueCapacity);
+    LineQueue wordQueue(pp.queueCapacity);
+    LineQueue outputQueue(pp.queueCapacity);
+    std::vector<std::thread> threads;
+    startStage(threads, pp.decodeWorkers, decodeQueue, detectQueue, [&](LineJob &job)
     {
-        //read offset line
-        QString offsetLine = input.readLine();
-        QStringList myStringList = offsetLine.split(' ');
-        int offsetX = myStringList[2].split('+')[1].toInt();
-        int offsetY = myStringList[3].split('+')[1].toInt();
-        m_DS.m_testImagesVector.clear();
-        cv::Mat image = cv::imread(filePath.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
+        QFile file(job.m_path);
+        if(!file.open(QIODevice::ReadOnly))
+            return;
+        QByteArray bytes = file.readAll();
+        if(!context.isEmpty())
+        {
+            QVector<CachedWord> cached;
+            job.m_cacheKey = RecognitionCache::key(bytes, context);
+            if(cache.find(job.m_cacheKey, cached))
+            {
+                // no image : the remaining stages pass the job through
+                job.m_fromCache = true;
+                for(const CachedWord &word : cached)
+                {
+                    job.m_words.push_back(word.m_word);
+                    job.m_wordConfs.push_back(word.m_conf);
+                    job.m_wordsRoi.push_back(word.m_roi);
+                }
+                return;
+            }
+        }
+        job.m_image = cv::imdecode(cv::Mat(1, bytes.size(), CV_8UC1, bytes.data()),
+                                   CV_LOAD_IMAGE_GRAYSCALE);
+        if(job.m_image.empty())
+            job.m_cacheKey.clear();
+    });
+    startStage(threads, pp.detectWorkers, detectQueue, inferenceQueue, [this](LineJob &job)
+    {
+        if(job.m_image.empty())
+            return;
         // Call word extractor
-        QVector<QRect> wordsRoi = TextRegionDetector::detectWordsFromLine(image,
-                                                                          m_parent);
-        //pad image and save to vector
-        cv::copyMakeBorder(image, image, m_params.probDistY, m_params.probDistY,
+        job.m_wordsRoi = TextRegionDetector::detectWordsFromLine(job.m_image, m_parent);
+        //pad image
+        cv::copyMakeBorder(job.m_image, job.m_image, m_params.probDistY, m_params.probDistY,
                            m_params.probDistX, m_params.probDistX, cv::BORDER_CONSTANT);
-        m_DS.m_testImagesVector.push_back(image);
-        //Note: index 0 because there is only one image at each step
+    });
+    startStage(threads, pp.inferenceWorkers, inferenceQueue, wordQueue, [this](LineJob &job)
+    {
+        if(job.m_image.empty())
+            return;
         QVector<quint32> fgPxNumberPerCol;
-        cv::Mat layeredImage = getLayeredHist(m_DS.m_testImagesVector[0], 0,
-                                              fgPxNumberPerCol);
-        for(QRect wordRoi : wordsRoi)
+        cv::Mat layeredImage = getLayeredHist(job.m_image, 0, fgPxNumberPerCol);
+        for(QRect wordRoi : job.m_wordsRoi)
         {
             cv::Rect layeredWordRoi = cv::Rect(wordRoi.x(), wordRoi.y(),
                                                wordRoi.width() * m_params.labelCount, wordRoi.height());
             // Crop layered words from layared image using extracted rects
             cv::Mat layeredWordRoiMat =  layeredImage(layeredWordRoi);
-            cv::Mat confidenceMat =  createLetterConfidenceMatrix(layeredWordRoiMat,
-                                                                  fgPxNumberPerCol);
+            job.m_confidences.push_back(createLetterConfidenceMatrix(layeredWordRoiMat,
+                                                                     fgPxNumberPerCol));
+        }
+        job.m_image.release();
+    });
+    startStage(threads, pp.wordDecodeWorkers, wordQueue, outputQueue, [](LineJob &job)
+    {
+        for(auto &confidenceMat : job.m_confidences)
+        {
             //FIXME : Nekruz baba top sende
             //            Util::plot(confidenceMat.row(23), m_parent, "x");
+            Q_UNUSED(confidenceMat);
             QString wordDetected = "baris";
             float conf = 0;
             //Util::getWordWithConfidance(confidenceMat,26,wordDetected,conf);
-            //            Util::plot(confidenceMat.row(23), m_parent, "x");
-            //save obtained result
-            output.write(wordDetected.toStdString().c_str());
-            output.write(" " + QByteArray::number(conf));
-            output.write(" " + QByteArray::number(++lineNo));
-            output.write(":" + QByteArray::number(wordRoi.width()));
-            output.write("X" + QByteArray::number(wordRoi.height()));
-            output.write("+" + QByteArray::number(offsetX + wordRoi.x()));
-            output.write("+" + QByteArray::number(offsetY + wordRoi.y()));
-            output.write("\n");
+            job.m_words.push_back(wordDetected);
+            job.m_wordConfs.push_back(conf);
+        }
+        job.m_confidences.clear();
+    });
+    threads.emplace_back([&]()
+    {
+        int index = 0;
+        for (auto filePath : fNames)
+        {
+            //read offset line
+            QString offsetLine = input.readLine();
+            // lines of a resumed run that are already committed
+            if (index < firstIndex)
+            {
+                ++index;
+                continue;
+            }
+            QStringList myStringList = offsetLine.split(' ');
+            LineJob job;
+            job.m_index = index++;
+            job.m_path = filePath;
+            job.m_offsetX = myStringList[2].split('+')[1].toInt();
+            job.m_offsetY = myStringList[3].split('+')[1].toInt();
+            decodeQueue.enqueue(std::move(job));
+        }
+        decodeQueue.close();
+    });
+    // output stage : jobs arrive out of order, write them in input order
+    auto lineNo = journal.lineNo();
+    int nextIndex = firstIndex;
+    QByteArray segment;
+    int segmentLines = 0;
+    std::map<int, LineJob> pending;
+    LineJob done;
+    while (outputQueue.dequeue(done))
+    {
+        pending.emplace(done.m_index, std::move(done));
+        for (auto it = pending.begin(); it != pending.end() && it->first == nextIndex;
+             it = pending.erase(it), ++nextIndex)
+        {
+            const LineJob &job = it->second;
+            if (!job.m_fromCache && !job.m_cacheKey.isEmpty())
+            {
+                QVector<CachedWord> words;
+                for (int i = 0; i < job.m_words.size(); ++i)
+                    words.push_back({job.m_words[i], job.m_wordConfs[i], job.m_wordsRoi[i]});
+                cache.insert(job.m_cacheKey, words);
+            }
+            for (int i = 0; i < job.m_words.size(); ++i)
+            {
+                const QRect &wordRoi = job.m_wordsRoi[i];
+                //save obtained result
+                segment += job.m_words[i].toStdString().c_str();
+                segment += " " + QByteArray::number(job.m_wordConfs[i]);
+                segment += " " + QByteArray::number(++lineNo);
+                segment += ":" + QByteArray::number(wordRoi.width());
+                segment += "X" + QByteArray::number(wordRoi.height());
+                segment += "+" + QByteArray::number(job.m_offsetX + wordRoi.x());
+                segment += "+" + QByteArray::number(job.m_offsetY + wordRoi.y());
+                segment += "\n";
+            }
+            // a failed checkpoint keeps its lines for the next one
+            if (++segmentLines >= pp.checkpointLines
+                    && journal.commitSegment(segment, it->first + 1, lineNo))
+            {
+                segment.clear();
+                segmentLines = 0;
+            }
         }
     }
-    output.close();
+    for (auto &thread : threads)
+        thread.join();
+    if (segmentLines > 0)
+        journal.commitSegment(segment, nextIndex, lineNo);
+    journal.finish();
     input.close();
     fNames.clear();
+    m_wordIndex.clear();
+    if(pp.useRecognitionCache)
+    {
+        if(shard.m_cacheFile.isEmpty())
+            cache.save();
+        else
+            cache.saveAdded(shard.m_cacheFile);
+        qDebug() << "Recognition cache hits : " << cache.hits() << " misses : " << cache.misses()
+                 << " hit rate : " << 100 * cache.hitRate() << "%";
+    }
+}
+
+// changes whenever the forest or anything else deciding the words of a line
+// image changes, so cached recognition results are only reused when valid
+QByteArray RandomDecisionForest::recognitionContext()
+{
+    std::ostringstream model(std::ios::binary);
+    {
+        cereal::BinaryOutputArchive ar(model);
+        ar(*this);
+    }
+    const std::string &bytes = model.str();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(bytes.data(), bytes.size());
+    QByteArray decoder;
+    QDataStream params(&decoder, QIODevice::WriteOnly);
+    params << RECOGNITION_DECODER_VERSION << m_params.probDistX << m_params.probDistY
+           << m_params.labelCount;
+    hash.addData(decoder);
+    return hash.result();
 }
 
 
@@ -183,8 +450,144 @@ void RandomDecisionForest::searchWords(QString query, int queryId)
     input.close();
 }
 
+// the index saved with formatted_output.txt while it is current, built from
+// the output otherwise
+bool RandomDecisionForest::loadWordIndex()
+{
+    if(!m_wordIndex.isEmpty())
+        return true;
+    if(m_wordIndex.load("./formatted_output.idx", "./formatted_output.txt"))
+        return true;
+    return m_wordIndex.build("./formatted_output.txt");
+}
+
+// approximate counterpart of searchWords : every query word matches recognized
+// words within maxDistance edits. Matches are written best first (edit distance,
+// then confidence) for each segment window that contains them.
+void RandomDecisionForest::searchWordsFuzzy(QString query, int queryId, int maxDistance)
+{
+    if(!loadWordIndex())
+        return;
+    QString endResultFile = "./end_result.txt";
+    QFile output(endResultFile);
+    if(!output.open(QIODevice::WriteOnly))
+        std::cout << "RandomDecisionForest::searchWordsFuzzy failed to open file! \n";
+    QStringList queryList = query.split(' ', QString::SkipEmptyParts);
+    for(QString search : queryList)
+    {
+        for(const WordMatch &match : m_wordIndex.fuzzyFind(search, maxDistance))
+        {
+            const WordRecord &rec = m_wordIndex.record(match.m_record);
+            QByteArray conf_bbox = " " + rec.m_confBox.toUtf8() + "\n";
+            int firstSegment = std::max(1, rec.m_lineId - SEGMENT_LINES + 1);
+            for(int segmentNo = firstSegment; segmentNo <= rec.m_lineId; ++segmentNo)
+            {
+                output.write(QByteArray::number(queryId));
+                output.write(" " + QByteArray::number(segmentNo));
+                output.write(conf_bbox);
+            }
+        }
+    }
+    output.close();
+}
 
 
+// Evaluates a whole query list in one pass over the positional index.
+// Each line of queryFile is "[queryId] word1 word2 ..."; without a leading id
+// the line number is used. Unlike searchWords, a segment is reported only when
+// all words of the query fall inside its window.
+void RandomDecisionForest::searchQueries(QString queryFile, int nThreads)
+{
+    if(!loadWordIndex())
+        return;
+    QFile input(queryFile);
+    if(!input.open(QIODevice::ReadOnly))
+    {
+        std::cout << "RandomDecisionForest::searchQueries failed to open file! \n";
+        return;
+    }
+    std::vector<int> queryIds;
+    std::vector<QStringList> queries;
+    int lineNo = 0;
+    while (!input.atEnd())
+    {
+        QStringList words = QString(input.readLine()).simplified().split(' ', QString::SkipEmptyParts);
+        ++lineNo;
+        if(words.isEmpty())
+            continue;
+        bool hasId;
+        int queryId = words[0].toInt(&hasId);
+        if(hasId)
+            words.removeFirst();
+        else
+            queryId = lineNo;
+        if(words.isEmpty())
+            continue;
+        queryIds.push_back(queryId);
+        queries.push_back(words);
+    }
+    input.close();
+    if(nThreads <= 0)
+        nThreads = QThread::idealThreadCount();
+    int nQueries = queries.size();
+    std::vector<QByteArray> results(nQueries);
+    #pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+    for(int q = 0; q < nQueries; ++q)
+        results[q] = evaluateQuery(queries[q], queryIds[q]);
+    QString endResultFile = "./end_result.txt";
+    QFile output(endResultFile);
+    if(!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "RandomDecisionForest::searchQueries failed to open file! \n";
+        return;
+    }
+    for(const QByteArray &result : results)
+        output.write(result);
+    output.close();
+    qDebug() << "Queries evaluated : " << nQueries;
+}
+
+QByteArray RandomDecisionForest::evaluateQuery(const QStringList &queryWords, int queryId) const
+{
+    // segments whose window contains every query word
+    std::vector<SegmentRange> segments = m_wordIndex.segmentsOf(queryWords[0]);
+    for(int i = 1; i < queryWords.size() && !segments.empty(); ++i)
+        segments = WordIndex::intersect(segments, m_wordIndex.segmentsOf(queryWords[i]));
+    QByteArray result;
+    if(segments.empty())
+        return result;
+    // walk the postings of each word alongside the matching segments
+    int nWords = queryWords.size();
+    std::vector<const std::vector<int> *> postings(nWords);
+    std::vector<size_t> first(nWords, 0);
+    for(int i = 0; i < nWords; ++i)
+        postings[i] = &m_wordIndex.postings(queryWords[i]);
+    QByteArray id = QByteArray::number(queryId);
+    for(const SegmentRange &range : segments)
+    {
+        for(int segmentNo = range.first; segmentNo <= range.second; ++segmentNo)
+        {
+            int segmentEnd = segmentNo + SEGMENT_LINES - 1;
+            QByteArray segment = id + " " + QByteArray::number(segmentNo) + " ";
+            for(int i = 0; i < nWords; ++i)
+            {
+                const std::vector<int> &posting = *postings[i];
+                while(first[i] < posting.size() &&
+                      m_wordIndex.record(posting[first[i]]).m_lineId < segmentNo)
+                    ++first[i];
+                for(size_t p = first[i]; p < posting.size(); ++p)
+                {
+                    const WordRecord &rec = m_wordIndex.record(posting[p]);
+                    if(rec.m_lineId > segmentEnd)
+                        break;
+                    result += segment + rec.m_confBox.toUtf8() + "\n";
+                }
+            }
+        }
+    }
+    return result;
+}
+
 //FOR TEST PURPOSES ONLY : given the image path, fills the vector with in the pixels of the image,
 //img_Info : label of  test image & id of the image inside vector(optional)
 void RandomDecisionForest::imageToPixels(std::vector<pixel_ptr> &res,
@@ -311,7 +714,7 @@ cv::Mat RandomDecisionForest::getLayeredHist(cv::Mat test_image, int index,
                 auto nForest = m_forest.size();
                 for(unsigned int i = 0; i < nForest; ++i)
                 {
-                    node_ptr leaf = m_forest[i]->getLeafNode(m_DS, px, 0);
+                    node_ptr leaf = m_forest[i]->getLeafNode(test_image, px, 0);
                     probHist += leaf->m_hist;
                 }
                 //Normalize the Histrograms
@@ -360,22 +763,84 @@ cv::Mat_<float> RandomDecisionForest::createLetterConfidenceMatrix(const cv::Mat
 
 void RandomDecisionForest::test()
 {
-    int nImages = m_DS.m_testImagesVector.size();
+    int nImages = m_DS.m_testImages.size();
     qDebug() << "Number of Test images:" << QString::number(nImages);
     for(auto i = 0; i < nImages; ++i)
     {
-        QVector<quint32> fgPxNumberPerCol;
-        cv::Mat layeredImage = getLayeredHist(m_DS.m_testImagesVector[i], i,
-                                              fgPxNumberPerCol);
-        cv::Mat_<float> confidenceMat = createLetterConfidenceMatrix(layeredImage, fgPxNumberPerCol);
-        //        std::cout<<confidenceMat.row(0)<<std::endl;
-        QString word = "Hello";
-        float conf = 0;
-        //        Util::plot(confidenceMat.row('n'-'a'), m_parent, "n");
-        Util::getWordWithConfidence(confidenceMat, 26, word, conf);
-        qDebug() << "Word extracted & conf: " << word << "  " << 100 * conf;
+        cv::Mat image = m_DS.m_testImages.image(i);
+        if(!image.empty())
+            classifyTestImage(image, i);
     }
     //    m_accuracy = Util::calculateAccuracy(m_DS.m_testlabels, classify_res);
     //    emit resultPercentage(m_accuracy);
 }
 
+// test() without reading the test set up front : a prefetcher thread reads the
+// next files through BulkFileReader, then decodes and pads them while the
+// current image is classified. At most 2 * prefetchDepth + 1 raw files (the
+// reads in flight, those queued for the decoder and the one it decodes) and
+// prefetchDepth + 2 decoded images are held at any time, images arrive in
+// completion order and carry their index
+void RandomDecisionForest::testStreaming(int prefetchDepth)
+{
+    m_dir = m_params.testDir;
+    if (QFileInfo(m_dir).isFile())
+    {
+        // a packed set is already streamed from the page cache
+        if (loadPackedTestSet(m_dir))
+            test();
+        return;
+    }
+    std::vector<QString> fNames;
+    m_DS.m_testlabels.clear();
+    Reader reader;
+    reader.findImages(m_dir, "", fNames, m_DS.m_testlabels);
+    int nImages = fNames.size();
+    qDebug() << "Number of Test images:" << QString::number(nImages);
+    BlockingQueue<TestJob> queue(prefetchDepth);
+    int probDistX = m_params.probDistX;
+    int probDistY = m_params.probDistY;
+    std::thread prefetcher([&]()
+    {
+        // a single decoder keeps up with the classifier, the reads run ahead
+        BulkFileReader files(prefetchDepth, 1);
+        files.read(fNames, [&](int i, std::vector<uchar> &bytes)
+        {
+            TestJob job;
+            job.m_index = i;
+            cv::Mat image;
+            if (!bytes.empty())
+                image = cv::imdecode(bytes, CV_LOAD_IMAGE_GRAYSCALE);
+            if (image.empty())
+                qWarning() << "ERROR : could not read " << fNames[i];
+            else
+                cv::copyMakeBorder(image, job.m_image, probDistY, probDistY,
+                                   probDistX, probDistX, cv::BORDER_CONSTANT);
+            queue.enqueue(std::move(job));
+        });
+        queue.close();
+    });
+    TestJob job;
+    while (queue.dequeue(job))
+    {
+        if (!job.m_image.empty())
+            classifyTestImage(job.m_image, job.m_index);
+        job.m_image.release();
+    }
+    prefetcher.join();
+}
+
+void RandomDecisionForest::classifyTestImage(const cv::Mat &image, int index)
+{
+    QVector<quint32> fgPxNumberPerCol;
+    cv::Mat layeredImage = getLayeredHist(image, index, fgPxNumberPerCol);
+    cv::Mat_<float> confidenceMat = createLetterConfidenceMatrix(layeredImage, fgPxNumberPerCol);
+    //        std::cout<<confidenceMat.row(0)<<std::endl;
+    QString word = "Hello";
+    float conf = 0;
+    //        Util::plot(confidenceMat.row('n'-'a'), m_parent, "n");
+    Util::getWordWithConfidence(confidenceMat, 26, word, conf);
+    qDebug() << "Word extracted & conf: " << word << "  " << 100 * conf;
+    emit classifiedTestImage(index, word, conf);
+}
+
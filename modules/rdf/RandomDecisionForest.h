@@ -4,6 +4,41 @@
 #include "RandomDecisionTree.h"
 #include "Util.h"
 #include "ocr/TextRegionDetector.h"
+#include "ocr/WordIndex.h"
+
+// worker counts of the readAndIdentifyWords stages and the depth of the
+// bounded queues between them
+struct RecognitionPipelineParams
+{
+    int decodeWorkers = 2;
+    int detectWorkers = 2;
+    int inferenceWorkers = QThread::idealThreadCount();
+    int wordDecodeWorkers = 1;
+    int queueCapacity = 16;
+    // reuse the words of line images already recognized with the same model
+    bool useRecognitionCache = true;
+    // lines per durable output segment, a restart resumes after the last one
+    int checkpointLines = 256;
+};
+
+// bumped whenever the word detection or decoding of a line changes, so that
+// results cached by an older version are not reused
+#define RECOGNITION_DECODER_VERSION 1
+
+// the part of the line images of m_params.testDir one readAndIdentifyWords
+// call works on and where its results go; output line numbers start at 1
+// within every shard
+struct RecognitionShard
+{
+    QString m_offsetsFile = "./combined.txt";
+    QString m_outputFile = "./formatted_output.txt";
+    int m_firstLine = 0;
+    // -1 : up to the last line image
+    int m_lineCount = -1;
+    // empty : new recognition results are saved to the shared cache, else
+    // only this shard's new results go here for the coordinator to merge
+    QString m_cacheFile;
+};
 
 class RandomDecisionForest : public QObject
 {
@@ -52,10 +87,19 @@ class RandomDecisionForest : public QObject
         file.close();
     }
 
-    void readAndIdentifyWords();
+    inline void readAndIdentifyWords()
+    {
+        readAndIdentifyWords(RecognitionShard());
+    }
+    void readAndIdentifyWords(const RecognitionShard &shard);
     void searchWords(QString query, int queryId);
+    void searchWordsFuzzy(QString query, int queryId, int maxDistance);
+    void searchQueries(QString queryFile, int nThreads = 0);
     void readTrainingImageFiles();
     void readTestImageFiles();
+    // packFile as written by PackedDataSet::build, padded by the probe distances
+    bool loadPackedTrainingSet(const QString &packFile);
+    bool loadPackedTestSet(const QString &packFile);
     void printPixelCloud();
     void printPixel(pixel_ptr px);
     int pixelCloudSize();
@@ -65,6 +109,8 @@ class RandomDecisionForest : public QObject
     cv::Mat colorCoder(const cv::Mat &labelImage, const cv::Mat &InputImage);
     void trainForest();
     void test();
+    // classifies the images under m_params.testDir as they are decoded
+    void testStreaming(int prefetchDepth = 4);
     cv::Mat getLayeredHist(cv::Mat test_image, int index,
                            QVector<quint32> &fgPxNumberPerCol);
     RDFParams &params()
@@ -74,11 +120,15 @@ class RandomDecisionForest : public QObject
     void setParams(const RDFParams &params)
     {
         m_params = params;
+        // shared by the train and test images
+        m_DS.m_trainImages.setBudget(m_params.imageCacheBytes);
+    }
+    RecognitionPipelineParams &pipelineParams()
+    {
+        return m_pipelineParams;
     }
     DataSet m_DS;
     std::vector<rdt_ptr> m_forest;
-    // Keep all images on memory
-    std::vector<cv::Mat> m_imagesContainer;
     inline void setParentWidget(QWidget *parent_widget)
     {
         m_parent = parent_widget;
@@ -92,25 +142,35 @@ class RandomDecisionForest : public QObject
         qDebug() << "}";
     }
 
-    QWidget *m_parent;
+    QWidget *m_parent = nullptr;
     RDFParams m_params;
+    RecognitionPipelineParams m_pipelineParams;
 
   private:
     //    rdfclock::time_point m_begin;
 
+    void classifyTestImage(const cv::Mat &image, int index);
+
     void placeHistogram(cv::Mat &output, const cv::Mat &pixelHist, int pos_row,
                         int pos_col);
+    QByteArray recognitionContext();
+    bool loadWordIndex();
+    QByteArray evaluateQuery(const QStringList &queryWords, int queryId) const;
     cv::Mat_<float> createLetterConfidenceMatrix(const cv::Mat &layeredHist, const QVector<quint32> &fgPxNumberPerCol);
     double m_accuracy;
     std::vector<QString> classify_res;
 
     QString m_dir;
     int m_numOfLetters = 0;
+    // built lazily from formatted_output.txt, dropped when it is rewritten
+    WordIndex m_wordIndex;
 
   signals:
     void classifiedImageAs(int image_no, char label);
     void treeConstructed();
     void resultPercentage(double accuracy);
+    // word and confidence recognized on test image image_no
+    void classifiedTestImage(int image_no, QString word, float conf);
 
 };
 
@@ -29,6 +29,7 @@ void RandomDecisionForestDialogGui::onTrainingBrowse()
 {
     PARAMS.trainImagesDir = QFileDialog::getExistingDirectory(this, tr("Open Image Directory"), QDir::currentPath(),
                                                               QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+    m_forest->params().trainImagesDir = PARAMS.trainImagesDir;
     m_forest->readTrainingImageFiles();
     ui->textBrowser_train->append("Training images read");
     ui->textBrowser_train->setText(PARAMS.trainImagesDir);
@@ -38,8 +39,6 @@ void RandomDecisionForestDialogGui::onTestBrowse()
 {
     PARAMS.testDir = QFileDialog::getExistingDirectory(this, tr("Open Image Directory"), PARAMS.trainImagesDir,
                                                        QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
-    m_forest->readTestImageFiles();
-    ui->textBrowser_test->append("Test images read");
     ui->textBrowser_test->setText(PARAMS.testDir);
 }
 
@@ -81,7 +80,7 @@ void RandomDecisionForestDialogGui::onTest()
         msgBox->show();
         return;
     }
-    m_forest->test();
+    m_forest->testStreaming();
 }
 
 void RandomDecisionForestDialogGui::new_tree_constructed()
@@ -130,7 +129,7 @@ void RandomDecisionForestDialogGui::onSave()
                                                         QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
     QString fname = "nT_" + QString::number(m_forest->params().nTrees) + "_D_" +
                     QString::number(m_forest->params().maxDepth)
-                    + "_nTImg_" + QString::number(m_forest->m_imagesContainer.size())
+                    + "_nTImg_" + QString::number(m_forest->m_DS.m_trainImages.size())
                     + "_nPxPI_" + QString::number(m_forest->params().pixelsPerImage)
                     + ".bin";
     m_forest->saveForest(dirname + "/" + fname);
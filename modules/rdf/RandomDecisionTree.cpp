@@ -74,37 +74,14 @@ void RandomDecisionTree::constructTree( Node &cur_node, PixelCloud &pixels)
 
 void RandomDecisionTree::subSample()
 {
-    int sampleId = 0;
-    std::vector<QString> trainingTextFiles;
-    Reader::readTextFiles(m_DF->m_params.trainAnnotationsDir, trainingTextFiles);
-    for(auto fname : trainingTextFiles)
-    {
-        QFile currAnnotateFile(fname);
-        if(!currAnnotateFile.open(QIODevice::ReadOnly))
-            std::cout <<
-                      "failed to open file! \n";
-        while(!currAnnotateFile.atEnd())
-        {
-            QString line = currAnnotateFile.readLine();
-            QStringList currImage = line.split(' ');
-            int imageId = currImage[0].split('.')[0].toInt();
-            if (!m_DF->m_DS.m_TrainHashTable.contains(imageId))
-            {
-                QString imageFullPath  = m_DF->m_dir + "/" + currImage[0];
-                cv::Mat image = cv::imread(imageFullPath.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
-                cv::copyMakeBorder(image, image, m_DF->m_params.probDistY, m_DF->m_params.probDistY, m_DF->m_params.probDistX,
-                                   m_DF->m_params.probDistX, cv::BORDER_CONSTANT);
-                m_DF->m_DS.m_TrainHashTable.insert(imageId, image);
-            }
-            else
-            {
-            }
-        }
-    }
-    for(auto &image : m_DF->m_DS.m_trainImagesVector)
+    const ImageStore &images = m_DF->m_DS.m_trainImages;
+    for(int sampleId = 0; sampleId < images.size(); ++sampleId)
     {
+        cv::Mat image = images.image(sampleId);
+        if(image.empty())
+            continue;
         auto label = m_DF->m_DS.m_trainlabels[sampleId];
-        imageinfo_ptr img_inf(new ImageInfo(label, sampleId++));
+        imageinfo_ptr img_inf(new ImageInfo(label, sampleId));
         int nRows = image.rows;
         int nCols = image.cols;
         for(int k = 0; k < m_DF->m_params.pixelsPerImage; ++k)
@@ -18,6 +18,7 @@
 #include "RDFParams.h"
 #include "3rdparty/matcerealisation.hpp"
 #include "ocr/Reader.h"
+#include "rdf/ImageStore.h"
 
 #define MIN_ENTROPY 0.05
 
@@ -52,10 +53,15 @@ struct Node
 
 struct DataSet
 {
+    DataSet()
+    {
+        // RDFParams::imageCacheBytes caps both sets together
+        m_testImages.shareBudget(m_trainImages);
+    }
 
-    QHash<int, cv::Mat> m_TrainHashTable;
-    std::vector<cv::Mat> m_trainImagesVector;
-    std::vector<cv::Mat> m_testImagesVector;
+    // padded images, index i belongs to label i
+    ImageStore m_trainImages;
+    ImageStore m_testImages;
     std::vector<QString> m_testlabels;
     std::vector<QString> m_trainlabels;
 
@@ -144,7 +150,7 @@ class RandomDecisionTree : public QObject
 
     void tuneParameters(std::vector<pixel_ptr> &parentPixels, Node &parent);
 
-    inline bool isLeft(pixel_ptr p, Node &node, cv::Mat &img)
+    inline bool isLeft(const pixel_ptr &p, const Node &node, const cv::Mat &img)
     {
         qint16 new_teta1R = node.m_teta1.m_dy + p->position.m_dy;
         qint16 new_teta1C = node.m_teta1.m_dx + p->position.m_dx;
@@ -156,6 +162,13 @@ class RandomDecisionTree : public QObject
     }
 
     inline node_ptr getLeafNode(const DataSet &DS, pixel_ptr px, int nodeId)
+    {
+        return getLeafNode(DS.m_testImages.image(px->imgInfo->m_sampleId), px, nodeId);
+    }
+
+    // img : padded image the pixel belongs to, lets callers classify images
+    // that are not stored in the data set (e.g. from several threads)
+    inline node_ptr getLeafNode(const cv::Mat &img, const pixel_ptr &px, int nodeId)
     {
         node_ptr root = m_nodes[nodeId];
         assert(root);
@@ -164,12 +177,11 @@ class RandomDecisionTree : public QObject
             // qDebug()<<"LEAF REACHED :"<<root.id;
             return root;
         }
-        cv::Mat img = DS.m_testImagesVector[px->imgInfo->m_sampleId];
         int childId = root->m_id * 2 ;
         //qDebug()<<"LEAF SEARCH :"<<root.id << " is leaf : " << root.isLeaf;
         if(!isLeft(px, *root, img))
             ++childId;
-        return getLeafNode(DS, px, childId - 1);
+        return getLeafNode(img, px, childId - 1);
     }
 
     bool isPixelSizeConsistent();
@@ -192,10 +204,17 @@ class RandomDecisionTree : public QObject
     inline void divide(const DataSet &DS, const PixelCloud &parentPixels,
                        std::vector<pixel_ptr> &left, std::vector<pixel_ptr> &right, Node &parent)
     {
+        // pixels of one image are adjacent in the cloud, keep the image at hand
+        // instead of going through the store for every pixel
+        int sampleId = -1;
+        cv::Mat img;
         for (auto px : parentPixels)
         {
-            //            auto img = DS.m_trainImagesVector[px->imgInfo->m_sampleId];
-            auto img = DS.m_TrainHashTable.value(px->imgInfo->m_sampleId);
+            if (px->imgInfo->m_sampleId != sampleId)
+            {
+                sampleId = px->imgInfo->m_sampleId;
+                img = DS.m_trainImages.image(sampleId);
+            }
             (isLeft(px, parent, img) ? left : right).push_back(px);
         }
     }
@@ -0,0 +1,178 @@
+#include "precompiled.h"
+
+#include <iostream>
+
+#include "rdf/RecognitionCache.h"
+
+// bumped whenever the cache layout changes
+static const quint32 CACHE_VERSION = 2;
+
+static QDataStream &operator<<(QDataStream &out, const CachedWord &word)
+{
+    return out << word.m_word << word.m_conf << word.m_roi;
+}
+
+static QDataStream &operator>>(QDataStream &in, CachedWord &word)
+{
+    return in >> word.m_word >> word.m_conf >> word.m_roi;
+}
+
+RecognitionCache::RecognitionCache(const QByteArray &context, const QString &cacheFile)
+    : m_context(context), m_cacheFile(cacheFile)
+{
+    if (m_cacheFile.isEmpty())
+        m_cacheFile = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                      + "/recognition.cache";
+}
+
+QByteArray RecognitionCache::fileContext(const QString &file)
+{
+    QFile input(file);
+    if (!input.open(QIODevice::ReadOnly))
+        return QByteArray();
+    QDataStream in(&input);
+    quint32 version;
+    QByteArray context;
+    in >> version >> context;
+    if (version != CACHE_VERSION || in.status() != QDataStream::Ok)
+        return QByteArray();
+    return context;
+}
+
+bool RecognitionCache::readLines(const QString &file, const QByteArray &context,
+                                 QHash<QByteArray, QVector<CachedWord>> &lines)
+{
+    QFile input(file);
+    if (!input.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&input);
+    quint32 version;
+    QByteArray fileContext;
+    in >> version >> fileContext;
+    if (version != CACHE_VERSION)
+        return false;
+    // a dead model's lines can never hit again
+    if (fileContext != context)
+        return true;
+    in >> lines;
+    if (in.status() != QDataStream::Ok)
+    {
+        lines.clear();
+        return false;
+    }
+    return true;
+}
+
+bool RecognitionCache::writeLines(const QString &file, const QByteArray &context,
+                                  const QHash<QByteArray, QVector<CachedWord>> &lines)
+{
+    QDir().mkpath(QFileInfo(file).absolutePath());
+    QSaveFile output(file);
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "RecognitionCache::save failed to open file! \n";
+        return false;
+    }
+    QDataStream out(&output);
+    out << CACHE_VERSION << context << lines;
+    return output.commit();
+}
+
+bool RecognitionCache::load()
+{
+    QMutexLocker locker(&m_mutex);
+    return readLines(m_cacheFile, m_context, m_lines);
+}
+
+bool RecognitionCache::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty)
+        return true;
+    QDir().mkpath(QFileInfo(m_cacheFile).absolutePath());
+    QLockFile lock(m_cacheFile + ".lock");
+    if (!lock.lock())
+    {
+        std::cout << "RecognitionCache::save failed to lock file! \n";
+        return false;
+    }
+    // whatever other runs saved since load stays
+    QHash<QByteArray, QVector<CachedWord>> lines;
+    readLines(m_cacheFile, m_context, lines);
+    for (auto it = m_added.constBegin(); it != m_added.constEnd(); ++it)
+        lines.insert(it.key(), it.value());
+    if (!writeLines(m_cacheFile, m_context, lines))
+        return false;
+    m_dirty = false;
+    return true;
+}
+
+bool RecognitionCache::saveAdded(const QString &file) const
+{
+    QMutexLocker locker(&m_mutex);
+    return writeLines(file, m_context, m_added);
+}
+
+bool RecognitionCache::merge(const QString &file)
+{
+    QHash<QByteArray, QVector<CachedWord>> lines;
+    if (!readLines(file, m_context, lines))
+        return false;
+    QMutexLocker locker(&m_mutex);
+    for (auto it = lines.constBegin(); it != lines.constEnd(); ++it)
+    {
+        m_lines.insert(it.key(), it.value());
+        m_added.insert(it.key(), it.value());
+    }
+    m_dirty = m_dirty || !lines.isEmpty();
+    return true;
+}
+
+QByteArray RecognitionCache::key(const QByteArray &imageBytes, const QByteArray &context)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(imageBytes);
+    hash.addData(context);
+    return hash.result();
+}
+
+bool RecognitionCache::find(const QByteArray &key, QVector<CachedWord> &words)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_lines.constFind(key);
+    if (it == m_lines.constEnd())
+    {
+        ++m_misses;
+        return false;
+    }
+    words = it.value();
+    ++m_hits;
+    return true;
+}
+
+void RecognitionCache::insert(const QByteArray &key, const QVector<CachedWord> &words)
+{
+    QMutexLocker locker(&m_mutex);
+    m_lines.insert(key, words);
+    m_added.insert(key, words);
+    m_dirty = true;
+}
+
+int RecognitionCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+int RecognitionCache::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+double RecognitionCache::hitRate() const
+{
+    QMutexLocker locker(&m_mutex);
+    int lookups = m_hits + m_misses;
+    return lookups == 0 ? 0 : (double)m_hits / lookups;
+}
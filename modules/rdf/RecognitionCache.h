@@ -0,0 +1,71 @@
+#ifndef CPV_RECOGNITION_CACHE
+#define CPV_RECOGNITION_CACHE
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+// one word recognized on a line image, roi relative to the line
+struct CachedWord
+{
+    QString m_word;
+    float m_conf;
+    QRect m_roi;
+};
+
+// Recognition results of line images kept across runs. A line is keyed by
+// the SHA1 of its file content together with a context hash of the model and
+// decoder parameters, so a changed image, a retrained forest or different
+// decoder settings all miss instead of returning stale words. The file holds
+// the lines of one context only : loading it under another context drops
+// them all and the next save writes the new context's lines alone.
+class RecognitionCache
+{
+  public:
+    // cacheFile empty : recognition.cache under the user cache directory
+    explicit RecognitionCache(const QByteArray &context, const QString &cacheFile = QString());
+
+    bool load();
+    // adds the lines inserted or merged since construction to what the file
+    // holds now, under a lock file, so concurrent runs keep each other's lines
+    bool save();
+    // writes only the lines inserted or merged since construction to file,
+    // for processes sharing one cache that merge their results afterwards
+    bool saveAdded(const QString &file) const;
+    // adds the lines of a file written by saveAdded under the same context
+    bool merge(const QString &file);
+    // context a cache file was written under, empty if unreadable
+    static QByteArray fileContext(const QString &file);
+
+    static QByteArray key(const QByteArray &imageBytes, const QByteArray &context);
+
+    // thread safe, counted as a hit or a miss
+    bool find(const QByteArray &key, QVector<CachedWord> &words);
+    void insert(const QByteArray &key, const QVector<CachedWord> &words);
+
+    int hits() const;
+    int misses() const;
+    // hits / lookups, 0 before the first lookup
+    double hitRate() const;
+
+  private:
+    // false if unreadable, lines of another context are skipped
+    static bool readLines(const QString &file, const QByteArray &context,
+                          QHash<QByteArray, QVector<CachedWord>> &lines);
+    static bool writeLines(const QString &file, const QByteArray &context,
+                           const QHash<QByteArray, QVector<CachedWord>> &lines);
+
+    QByteArray m_context;
+    QString m_cacheFile;
+    QHash<QByteArray, QVector<CachedWord>> m_lines;
+    QHash<QByteArray, QVector<CachedWord>> m_added;
+    mutable QMutex m_mutex;
+    int m_hits = 0;
+    int m_misses = 0;
+    bool m_dirty = false;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "precompiled.h"
+
+#include <iostream>
+#include <unistd.h>
+
+#include "rdf/RecognitionJournal.h"
+
+RecognitionJournal::RecognitionJournal(const QString &outputFile)
+    : m_outputFile(outputFile), m_partsDir(outputFile + ".parts"), m_journal(outputFile + ".journal")
+{
+}
+
+QString RecognitionJournal::segmentFile(int segment) const
+{
+    return m_partsDir + "/" + QString::number(segment) + ".txt";
+}
+
+bool RecognitionJournal::begin(const QByteArray &runId)
+{
+    m_segments = 0;
+    m_nextIndex = 0;
+    m_lineNo = 0;
+    QByteArray header = "run " + runId.toHex() + "\n";
+    QByteArray valid = header;
+    if (m_journal.open(QIODevice::ReadOnly))
+    {
+        // "segment n nextIndex lineNo" lines, a torn last line or a lost
+        // segment file ends what can be trusted
+        if (m_journal.readLine() == header)
+        {
+            while (!m_journal.atEnd())
+            {
+                QByteArray line = m_journal.readLine();
+                QList<QByteArray> fields = line.trimmed().split(' ');
+                if (!line.endsWith('\n') || fields.size() != 4 || fields[0] != "segment"
+                        || fields[1].toInt() != m_segments || !QFile::exists(segmentFile(m_segments)))
+                    break;
+                m_nextIndex = fields[2].toInt();
+                m_lineNo = fields[3].toInt();
+                ++m_segments;
+                valid += line;
+            }
+        }
+        m_journal.close();
+    }
+    if (m_segments > 0)
+        qDebug() << "Resuming recognition after " << m_nextIndex << " lines, "
+                 << m_segments << " segments";
+    else
+        QDir(m_partsDir).removeRecursively();
+    QDir().mkpath(m_partsDir);
+    // rewrite the journal without anything past the last good entry
+    QSaveFile journal(m_journal.fileName());
+    if (!journal.open(QIODevice::WriteOnly) || journal.write(valid) != valid.size() || !journal.commit())
+    {
+        std::cout << "RecognitionJournal::begin failed to write file! \n";
+        return false;
+    }
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        std::cout << "RecognitionJournal::begin failed to open file! \n";
+        return false;
+    }
+    return true;
+}
+
+bool RecognitionJournal::appendJournal(const QByteArray &line)
+{
+    if (m_journal.write(line) != line.size() || !m_journal.flush())
+        return false;
+    return fsync(m_journal.handle()) == 0;
+}
+
+bool RecognitionJournal::commitSegment(const QByteArray &bytes, int nextIndex, int lineNo)
+{
+    // QSaveFile::commit syncs the segment to disk before renaming it
+    QSaveFile segment(segmentFile(m_segments));
+    if (!segment.open(QIODevice::WriteOnly) || segment.write(bytes) != bytes.size()
+            || !segment.commit())
+    {
+        std::cout << "RecognitionJournal::commitSegment failed to write file! \n";
+        return false;
+    }
+    QByteArray line = "segment " + QByteArray::number(m_segments) + " " + QByteArray::number(nextIndex)
+                      + " " + QByteArray::number(lineNo) + "\n";
+    if (!appendJournal(line))
+    {
+        std::cout << "RecognitionJournal::commitSegment failed to write file! \n";
+        return false;
+    }
+    ++m_segments;
+    m_nextIndex = nextIndex;
+    m_lineNo = lineNo;
+    return true;
+}
+
+bool RecognitionJournal::finish()
+{
+    QSaveFile output(m_outputFile);
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "RecognitionJournal::finish failed to open file! \n";
+        return false;
+    }
+    for (int i = 0; i < m_segments; ++i)
+    {
+        QFile segment(segmentFile(i));
+        if (!segment.open(QIODevice::ReadOnly) || output.write(segment.readAll()) != segment.size())
+        {
+            std::cout << "RecognitionJournal::finish failed to read file! \n";
+            output.cancelWriting();
+            return false;
+        }
+    }
+    if (!output.commit())
+    {
+        std::cout << "RecognitionJournal::finish failed to write file! \n";
+        return false;
+    }
+    // the output is durable, the checkpoints are no longer needed
+    m_journal.close();
+    m_journal.remove();
+    QDir(m_partsDir).removeRecursively();
+    m_segments = 0;
+    return true;
+}
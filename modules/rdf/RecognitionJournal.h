@@ -0,0 +1,50 @@
+#ifndef CPV_RECOGNITION_JOURNAL
+#define CPV_RECOGNITION_JOURNAL
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+// Checkpoints of a recognition run writing outputFile. Output is committed in
+// segments under outputFile.parts, each one fsynced before a line naming it
+// is appended to outputFile.journal, so after a crash the journal only lists
+// complete segments. A restart of the same run resumes after the last one;
+// finish() concatenates the segments into outputFile atomically.
+class RecognitionJournal
+{
+  public:
+    explicit RecognitionJournal(const QString &outputFile);
+
+    // resumes the run identified by runId if the journal belongs to it,
+    // starts a fresh one otherwise
+    bool begin(const QByteArray &runId);
+    // index of the first input line not covered by a committed segment
+    inline int nextIndex() const
+    {
+        return m_nextIndex;
+    }
+    // number of output lines committed so far
+    inline int lineNo() const
+    {
+        return m_lineNo;
+    }
+
+    // durably writes bytes as the next segment, covering input lines up to
+    // nextIndex and output lines up to lineNo
+    bool commitSegment(const QByteArray &bytes, int nextIndex, int lineNo);
+    // merges the segments into the output file and removes the checkpoints
+    bool finish();
+
+  private:
+    QString segmentFile(int segment) const;
+    bool appendJournal(const QByteArray &line);
+
+    QString m_outputFile;
+    QString m_partsDir;
+    QFile m_journal;
+    int m_segments = 0;
+    int m_nextIndex = 0;
+    int m_lineNo = 0;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "precompiled.h"
+
+#include <iostream>
+#include <memory>
+
+#include "rdf/ShardedRecognition.h"
+#include "rdf/RandomDecisionForest.h"
+#include "ocr/Reader.h"
+#include "ocr/WordIndex.h"
+#include "rdf/RecognitionCache.h"
+
+QString ShardedRecognition::shardOutput(const ShardParams &params, int shard)
+{
+    return params.m_workDir + "/shard_" + QString::number(shard) + ".txt";
+}
+
+QString ShardedRecognition::shardCache(const ShardParams &params, int shard)
+{
+    return params.m_workDir + "/shard_" + QString::number(shard) + ".cache";
+}
+
+QStringList ShardedRecognition::workerArguments(const ShardParams &params, int shard,
+                                                int firstLine, int lineCount)
+{
+    QStringList args = QStringList() << "--recognize-shard" << params.m_forestFile
+                       << params.m_testDir << params.m_offsetsFile << QString::number(firstLine)
+                       << QString::number(lineCount) << shardOutput(params, shard)
+                       << shardCache(params, shard);
+    if (params.m_verbose)
+        args << "--verbose";
+    return args;
+}
+
+bool ShardedRecognition::run(const ShardParams &params, const QString &outputFile,
+                             const QString &indexFile)
+{
+    std::vector<QString> fNames;
+    Reader reader;
+    reader.findImages(params.m_testDir, "", fNames);
+    int nLines = fNames.size();
+    int nShards = std::max(1, std::min(params.m_nShards, nLines));
+    if (!QDir().mkpath(params.m_workDir))
+    {
+        qWarning() << "ERROR : " << params.m_workDir << " can not be created!";
+        return false;
+    }
+    // the same command lines, for running shards by hand on other hosts
+    QFile commands(params.m_workDir + "/shards.txt");
+    if (!commands.open(QIODevice::WriteOnly))
+        std::cout << "ShardedRecognition::run failed to open file! \n";
+    QString program = QCoreApplication::applicationFilePath();
+    QStringList outputs;
+    QStringList caches;
+    std::vector<QStringList> pendingArgs;
+    for (int shard = 0; shard < nShards; ++shard)
+    {
+        int first = (qint64)nLines * shard / nShards;
+        int last = (qint64)nLines * (shard + 1) / nShards;
+        QStringList args = workerArguments(params, shard, first, last - first);
+        commands.write((program + " " + args.join(' ') + "\n").toUtf8());
+        outputs << shardOutput(params, shard);
+        caches << shardCache(params, shard);
+        // outputs are committed atomically, an existing one is complete
+        if (!QFile::exists(outputs.back()))
+            pendingArgs.push_back(args);
+    }
+    commands.close();
+    int nParallel = params.m_nParallel > 0 ? params.m_nParallel : nShards;
+    std::vector<std::unique_ptr<QProcess>> running;
+    size_t next = 0;
+    bool failed = false;
+    while (next < pendingArgs.size() || !running.empty())
+    {
+        while (next < pendingArgs.size() && (int)running.size() < nParallel)
+        {
+            std::unique_ptr<QProcess> worker(new QProcess());
+            worker->setProcessChannelMode(QProcess::ForwardedChannels);
+            worker->start(program, pendingArgs[next++]);
+            if (!worker->waitForStarted(-1))
+            {
+                qWarning() << "ERROR : could not start " << program;
+                failed = true;
+                continue;
+            }
+            running.push_back(std::move(worker));
+        }
+        for (auto it = running.begin(); it != running.end();)
+        {
+            if (!(*it)->waitForFinished(100))
+            {
+                ++it;
+                continue;
+            }
+            if ((*it)->exitStatus() != QProcess::NormalExit || (*it)->exitCode() != 0)
+            {
+                qWarning() << "ERROR : shard worker failed " << (*it)->arguments();
+                failed = true;
+            }
+            it = running.erase(it);
+        }
+    }
+    // a rerun only starts the shards that did not finish
+    if (failed)
+        return false;
+    if (!merge(outputs, outputFile, indexFile, caches))
+        return false;
+    QDir(params.m_workDir).removeRecursively();
+    return true;
+}
+
+bool ShardedRecognition::merge(const QStringList &shardOutputs, const QString &outputFile,
+                               const QString &indexFile, const QStringList &shardCaches)
+{
+    QSaveFile output(outputFile);
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "ShardedRecognition::merge failed to open file! \n";
+        return false;
+    }
+    int lineNo = 0;
+    for (const QString &shardFile : shardOutputs)
+    {
+        QFile input(shardFile);
+        if (!input.open(QIODevice::ReadOnly))
+        {
+            std::cout << "ShardedRecognition::merge failed to open file! \n";
+            output.cancelWriting();
+            return false;
+        }
+        // "word conf lineNo:WxH+X+Y", lineNo counts from 1 in every shard
+        while (!input.atEnd())
+        {
+            QByteArray line = input.readLine().trimmed();
+            QList<QByteArray> fields = line.split(' ');
+            if (fields.size() < 3)
+                continue;
+            int colon = fields[2].indexOf(':');
+            output.write(fields[0] + " " + fields[1] + " " + QByteArray::number(++lineNo)
+                         + fields[2].mid(colon) + "\n");
+        }
+    }
+    if (!output.commit())
+    {
+        std::cout << "ShardedRecognition::merge failed to write file! \n";
+        return false;
+    }
+    WordIndex index;
+    if (!index.build(outputFile) || !index.save(indexFile, outputFile))
+        return false;
+    qDebug() << "Merged " << shardOutputs.size() << " shards, " << lineNo << " words";
+    // a shard that crashed after committing its output only misses its cache
+    if (!shardCaches.isEmpty())
+    {
+        // all shards ran the same model
+        QByteArray context;
+        for (const QString &shardCache : shardCaches)
+            if (context.isEmpty())
+                context = RecognitionCache::fileContext(shardCache);
+        RecognitionCache cache(context);
+        for (const QString &shardCache : shardCaches)
+            if (QFile::exists(shardCache) && !cache.merge(shardCache))
+                qWarning() << "ERROR : could not read " << shardCache;
+        // save adds the shards' lines to those already in the shared cache
+        cache.save();
+    }
+    return true;
+}
+
+int ShardedRecognition::runShard(const QStringList &arguments)
+{
+    // verbosity is up to the program's message handler
+    QStringList args = arguments;
+    args.removeAll("--verbose");
+    if (args.size() != 7)
+    {
+        std::cout << "usage : --recognize-shard forestFile testDir offsetsFile firstLine lineCount outputFile cacheFile [--verbose]\n";
+        return 2;
+    }
+    if (!QFile::exists(args[0]))
+    {
+        qWarning() << "ERROR : " << args[0] << " does not exist!";
+        return 1;
+    }
+    RandomDecisionForest forest;
+    forest.loadForest(args[0]);
+    forest.params().testDir = args[1];
+    RecognitionShard shard;
+    shard.m_offsetsFile = args[2];
+    shard.m_firstLine = args[3].toInt();
+    shard.m_lineCount = args[4].toInt();
+    shard.m_outputFile = args[5];
+    shard.m_cacheFile = args[6];
+    forest.readAndIdentifyWords(shard);
+    return QFile::exists(shard.m_outputFile) ? 0 : 1;
+}
+
+int ShardedRecognition::runCoordinator(const QStringList &args)
+{
+    if (args.size() < 3)
+    {
+        std::cout << "usage : --recognize-sharded forestFile testDir nShards [workDir [offsetsFile]]\n";
+        return 2;
+    }
+    ShardParams params;
+    params.m_forestFile = QFileInfo(args[0]).absoluteFilePath();
+    params.m_testDir = QFileInfo(args[1]).absoluteFilePath();
+    params.m_nShards = args[2].toInt();
+    if (args.size() > 3)
+        params.m_workDir = args[3];
+    if (args.size() > 4)
+        params.m_offsetsFile = args[4];
+    params.m_workDir = QFileInfo(params.m_workDir).absoluteFilePath();
+    params.m_offsetsFile = QFileInfo(params.m_offsetsFile).absoluteFilePath();
+    return run(params, "./formatted_output.txt", "./formatted_output.idx") ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#ifndef CPV_SHARDED_RECOGNITION
+#define CPV_SHARDED_RECOGNITION
+
+#include <QString>
+#include <QStringList>
+
+struct ShardParams
+{
+    QString m_forestFile;
+    QString m_testDir;
+    QString m_offsetsFile = "./combined.txt";
+    // shard outputs, checkpoints and the worker command lines
+    QString m_workDir = "./shards";
+    int m_nShards = 2;
+    // workers running at once on this host, 0 : all shards
+    int m_nParallel = 0;
+    // passes --verbose on to the workers
+    bool m_verbose = false;
+};
+
+// readAndIdentifyWords split over several processes. The coordinator cuts the
+// line images of the test directory into contiguous shards and starts one
+// "<program> --recognize-shard" worker per shard. Workers only need the forest
+// file, the line images and the offsets file, so the command lines written to
+// workDir/shards.txt can as well be run on other hosts sharing the file
+// system. Each shard numbers its output lines from 1; merge renumbers them
+// into one output and saves the word index for it. Workers look lines up in
+// the shared recognition cache but write their new results to a cache file
+// of their own, merge folds those into the shared cache, so concurrent
+// workers never overwrite each other's results.
+class ShardedRecognition
+{
+  public:
+    // runs the shards not finished yet, then merges all of them
+    static bool run(const ShardParams &params, const QString &outputFile,
+                    const QString &indexFile);
+    static bool merge(const QStringList &shardOutputs, const QString &outputFile,
+                      const QString &indexFile, const QStringList &shardCaches = QStringList());
+
+    static QString shardOutput(const ShardParams &params, int shard);
+    static QString shardCache(const ShardParams &params, int shard);
+    // forestFile testDir offsetsFile firstLine lineCount outputFile cacheFile [--verbose]
+    static QStringList workerArguments(const ShardParams &params, int shard, int firstLine,
+                                       int lineCount);
+    // worker side of --recognize-shard, args as built by workerArguments
+    static int runShard(const QStringList &arguments);
+    // --recognize-sharded forestFile testDir nShards [workDir [offsetsFile]]
+    static int runCoordinator(const QStringList &args);
+};
+
+#endif
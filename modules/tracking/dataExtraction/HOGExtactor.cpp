@@ -1,22 +1,19 @@
 #include "precompiled.h"
 
 #include "HOGExtactor.h"
-#include <QFileDialog>
 #include "Util.h"
+#include "ocr/DatasetManifest.h"
 
-HOGExtactor::HOGExtactor()
+HOGExtactor::HOGExtactor(const QString &dir, const QString &outFile)
 {
-    QString dir = QFileDialog::getExistingDirectory(nullptr, QObject::tr("Open Directory"),
-                                                    "/home",
-                                                    QFileDialog::ShowDirsOnly
-                                                    | QFileDialog::DontResolveSymlinks);
     getTrainingData(dir);
     extractHOG();
     //    int maxComponents = 2;
     cv::Mat_<float> data;
     for (auto desc : m_trainDataDescriptors)
         data.push_back((cv::Mat_<float>(desc)).t());
-    Util::writeMatToFile(data, "../negDes.txt");
+    if (!outFile.isEmpty())
+        Util::writeMatToFile(data, outFile.toStdString().c_str());
     //    cv::PCA pca_analysis(data, cv::Mat(), CV_PCA_DATA_AS_ROW,maxComponents);
     //    cv::Mat proj = data*pca_analysis.eigenvectors.t();
     //    Util::writeMatToFile(proj,"../neg.txt");
@@ -26,13 +23,10 @@ HOGExtactor::HOGExtactor()
 
 void HOGExtactor::getTrainingData(QString baseDir)
 {
-    QDirIterator itFile(baseDir, QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files,
-                        QDirIterator::Subdirectories);
-    while (itFile.hasNext())
-    {
-        itFile.next();
-        m_trainDataFiles.append(itFile.filePath().toStdString());
-    }
+    std::vector<QString> files;
+    DatasetManifest::open(baseDir)->filesRecursive(DatasetManifest::imageFilters(), files);
+    for (const QString &file : files)
+        m_trainDataFiles.append(file.toStdString());
 }
 
 void HOGExtactor::extractHOG()
@@ -18,7 +18,8 @@ void doForAll(const QVector<std::string> &v_filePath,
 class HOGExtactor
 {
   public:
-    HOGExtactor();
+    // descriptors of every image under dir, written to outFile when given
+    explicit HOGExtactor(const QString &dir, const QString &outFile = QString());
 
     inline int getDataSize() {return m_trainDataDescriptors.size();}
 
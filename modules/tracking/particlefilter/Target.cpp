@@ -6,7 +6,7 @@ Target::Target(QString label, QImage image, int histSize)
 {
     m_label = label;
     m_histSize = histSize;
-    m_targetImg = Util::toCv(image, CV_8UC4);
+    m_targetImg = Util::toCvShared(std::move(image), CV_8UC4);
     cv::cvtColor(m_targetImg, m_targetImg, CV_RGBA2RGB);
     Util::CalculateHistogram(m_targetImg, m_targetHist, m_histSize);
 }
@@ -24,7 +24,7 @@ void Target::setLabel(QString label)
 
 void Target::setImage(QImage image)
 {
-    m_targetImg = Util::toCv(image, CV_8UC4);
+    m_targetImg = Util::toCvShared(std::move(image), CV_8UC4);
     cv::cvtColor(m_targetImg, m_targetImg, CV_RGBA2RGB);
     Util::CalculateHistogram(m_targetImg, m_targetHist, m_histSize);
 }
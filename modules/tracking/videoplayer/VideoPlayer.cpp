@@ -25,7 +25,7 @@ void VideoPlayer::run()
         if (m_PF)
             processImage(m_PF);
         else
-            m_img = Util::toQt(m_RGBframe, QImage::Format_RGB888);
+            m_img = Util::wrapQt(m_RGBframe, QImage::Format_RGB888);
         emit playerFrame(m_img);
         //        cv::imshow("FG Mask fgMOG_no_hole", m_fgMaskMOG2_noHole);
         //        cv::imshow("FG Mask", m_fgMaskMOG2);
@@ -49,7 +49,7 @@ void VideoPlayer::processImage(ImgProcessor process)
     process->setIMG(&m_RGBframe);
     process->processImage();
     m_frame_out = process->getIMG();
-    m_img = Util::toQt(m_frame_out, QImage::Format_RGB888);
+    m_img = Util::wrapQt(m_frame_out, QImage::Format_RGB888);
 }
 
 /**  @function Erosion  */
@@ -98,7 +98,7 @@ void VideoPlayer::initializeVideo()
     while (m_FrameBuffer->size() < 1) {};
     m_RGBframe = m_FrameBuffer->dequeue();
     m_CurrentFrame++;
-    m_img = Util::toQt(m_RGBframe, QImage::Format_RGB888);
+    m_img = Util::wrapQt(m_RGBframe, QImage::Format_RGB888);
 }
 
 bool VideoPlayer::loadVideo(std::string filename)
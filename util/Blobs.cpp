@@ -1,9 +1,7 @@
 #include "precompiled.h"
 #include "Util.h"
 
-
-// TODO : update this
-#define COUNTFOR_BACKGROUND 0
+#include <climits>
 
 #include "Blobs.h"
 
@@ -16,26 +14,38 @@ void renderBlobs(
     const QVector<bool> &bAllowed
 )
 {
+    Q_UNUSED(centroids);
     int nLabels = statsv.rows;
+    int nRows = imgBinary.rows;
+    int nCols = imgBinary.cols;
+    const bool *allowed = bAllowed.constData();
     auto ot = imgOutput.type();
     if (ot == CV_8UC1) // mask output
     {
-        doForAllPixels(imgBinary, [&](quint16 value, quint16 x, quint16 y)
+        #pragma omp parallel for
+        for (int y = 0; y < nRows; ++y)
         {
-            imgOutput.at<quint8>(y, x) = (quint8)(bAllowed[labels(y, x)] ? value : 0);
-        });
+            const quint8 *pValue = imgBinary[y];
+            const qint32 *pLabel = labels[y];
+            quint8 *pOut = imgOutput.ptr<quint8>(y);
+            for (int x = 0; x < nCols; ++x)
+                pOut[x] = allowed[pLabel[x]] ? pValue[x] : 0;
+        }
     }
     else if (ot == CV_16UC1) // label output
     {
-        doForAllPixels(imgBinary, [&](quint16 value, quint16 x, quint16 y)
+        #pragma omp parallel for
+        for (int y = 0; y < nRows; ++y)
         {
-            auto label = labels(y, x);
-            imgOutput.at<quint16>(y, x) = bAllowed[label] ? label : 0;
-        });
+            const qint32 *pLabel = labels[y];
+            quint16 *pOut = imgOutput.ptr<quint16>(y);
+            for (int x = 0; x < nCols; ++x)
+                pOut[x] = allowed[pLabel[x]] ? (quint16)pLabel[x] : 0;
+        }
     }
     else if (ot == CV_8UC3) // color output
     {
-        std::vector<cv::Vec3b> palette(nLabels);
+        std::vector<cv::Vec3b> palette(nLabels, cv::Vec3b(0, 0, 0));
         quint32 nColors = 0;
         for (int i = COUNTFOR_BACKGROUND; i < nLabels; ++i)
         {
@@ -45,34 +55,163 @@ void renderBlobs(
                 palette[i] = cv::Vec3b(color.blue(), color.green(), color.red());
             }
         }
-        doForAllPixels(imgBinary, [&](quint16 value, quint16 x, quint16 y)
+        #pragma omp parallel for
+        for (int y = 0; y < nRows; ++y)
         {
-            auto label = labels(y, x);
-            imgOutput.at<cv::Vec3b>(y, x) = bAllowed[label] ? palette[label] : cv::Vec3b(0, 0, 0);
-        });
+            const qint32 *pLabel = labels[y];
+            cv::Vec3b *pOut = imgOutput.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < nCols; ++x)
+                pOut[x] = palette[pLabel[x]];
+        }
     }
 }
 
-void doForAllBlobs(const BinaryImage &imgBinary, cv::Mat imgOutput, std::function < bool(BlobData &&) > func)
+BlobScanner::BlobScanner(int cols) : m_cols(cols)
 {
-    IntMat labels, statsv;
-    DoubleMat centroids;
-    cv::connectedComponentsWithStats(imgBinary, labels, statsv, centroids);
-    int nLabels = statsv.rows;
-    QVector<bool> bAllowed; // array to track if a blob is allowed after the filtering
-    if (!imgOutput.empty())
+    m_background = {cols, INT_MAX, -1, -1, 0, 0, 0};
+}
+
+int BlobScanner::find(int label)
+{
+    while (m_parent[label] != label)
     {
-        Q_ASSERT(imgOutput.type() == CV_8UC1 || imgOutput.type() == CV_16UC1 || imgOutput.type() == CV_8UC3);
-        bAllowed.resize(nLabels);
+        m_parent[label] = m_parent[m_parent[label]];
+        label = m_parent[label];
+    }
+    return label;
+}
+
+void BlobScanner::unite(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b)
+        return;
+    Stats &sa = m_stats[a];
+    const Stats &sb = m_stats[b];
+    sa.m_minX = std::min(sa.m_minX, sb.m_minX);
+    sa.m_minY = std::min(sa.m_minY, sb.m_minY);
+    sa.m_maxX = std::max(sa.m_maxX, sb.m_maxX);
+    sa.m_maxY = std::max(sa.m_maxY, sb.m_maxY);
+    sa.m_area += sb.m_area;
+    sa.m_sumX += sb.m_sumX;
+    sa.m_sumY += sb.m_sumY;
+    m_parent[b] = a;
+}
+
+BlobData BlobScanner::toBlob(const Stats &stats) const
+{
+    if (stats.m_area == 0)
+        return BlobData(cv::Rect(), 0, cv::Vec2d(0, 0));
+    return BlobData(cv::Rect(stats.m_minX, stats.m_minY, stats.m_maxX - stats.m_minX + 1,
+                             stats.m_maxY - stats.m_minY + 1),
+                    stats.m_area,
+                    cv::Vec2d(stats.m_sumX / stats.m_area, stats.m_sumY / stats.m_area));
+}
+
+void BlobScanner::pushRow(const quint8 *row, std::vector<BlobData> &done)
+{
+    int y = m_row++;
+    // runs of this row, each one a fresh label
+    m_cur.clear();
+    double fgSumX = 0;
+    int fgCount = 0;
+    for (int x = 0; x < m_cols;)
+    {
+        if (!row[x])
+        {
+            ++x;
+            continue;
+        }
+        int begin = x;
+        while (x < m_cols && row[x])
+            ++x;
+        int label = m_parent.size();
+        int length = x - begin;
+        double sumX = (double)(begin + x - 1) * length / 2;
+        m_parent.push_back(label);
+        m_stats.push_back({begin, y, x - 1, y, (quint32)length, sumX, (double)y * length});
+        m_cur.push_back({begin, x, label});
+        fgSumX += sumX;
+        fgCount += length;
     }
-    for (int label = COUNTFOR_BACKGROUND; label < nLabels; ++label) // start from 1, 0 is background label
+    // background of this row
+    if (fgCount < m_cols)
     {
-        auto *P = statsv.ptr<int>(label);
-        cv::Rect rect{P[cv::CC_STAT_LEFT], P[cv::CC_STAT_TOP], P[cv::CC_STAT_WIDTH], P[cv::CC_STAT_HEIGHT]};
-        bool bFilterResult = func(BlobData(rect, P[cv::CC_STAT_AREA], {centroids(label, 0), centroids(label, 1)}));
-        if (!bAllowed.empty())
-            bAllowed[label] = bFilterResult;
+        Stats &bg = m_background;
+        int bgCount = m_cols - fgCount;
+        bg.m_minX = std::min(bg.m_minX, (!m_cur.empty() && m_cur.front().m_begin == 0) ? m_cur.front().m_end : 0);
+        bg.m_maxX = std::max(bg.m_maxX, (!m_cur.empty() && m_cur.back().m_end == m_cols) ? m_cur.back().m_begin - 1 : m_cols - 1);
+        bg.m_minY = std::min(bg.m_minY, y);
+        bg.m_maxY = y;
+        bg.m_area += bgCount;
+        bg.m_sumX += (double)(m_cols - 1) * m_cols / 2 - fgSumX;
+        bg.m_sumY += (double)y * bgCount;
     }
-    if (!bAllowed.empty())
-        renderBlobs(imgBinary, imgOutput, labels, statsv, centroids, bAllowed);
+    // 8-connectivity : [pb, pe) touches [cb, ce) when pb <= ce and cb <= pe
+    size_t i = 0, j = 0;
+    while (i < m_prev.size() && j < m_cur.size())
+    {
+        const Run &p = m_prev[i];
+        const Run &c = m_cur[j];
+        if (p.m_begin <= c.m_end && c.m_begin <= p.m_end)
+            unite(p.m_label, c.m_label);
+        if (p.m_end < c.m_end)
+            ++i;
+        else
+            ++j;
+    }
+    // blobs of the previous row that this row does not continue are complete
+    m_touched.assign(m_parent.size(), false);
+    for (const Run &c : m_cur)
+        m_touched[find(c.m_label)] = true;
+    for (const Run &p : m_prev)
+    {
+        int root = find(p.m_label);
+        if (!m_touched[root])
+        {
+            done.push_back(toBlob(m_stats[root]));
+            m_touched[root] = true;     // report once
+        }
+    }
+    // keep only the roots of this row, relabelled from 0
+    std::vector<int> newLabel(m_parent.size(), -1);
+    std::vector<Stats> stats;
+    for (Run &c : m_cur)
+    {
+        int root = find(c.m_label);
+        if (newLabel[root] < 0)
+        {
+            newLabel[root] = stats.size();
+            stats.push_back(m_stats[root]);
+        }
+        c.m_label = newLabel[root];
+    }
+    m_stats.swap(stats);
+    m_parent.resize(m_stats.size());
+    for (size_t k = 0; k < m_parent.size(); ++k)
+        m_parent[k] = k;
+    m_prev.swap(m_cur);
+}
+
+void BlobScanner::finish(std::vector<BlobData> &done)
+{
+    m_touched.assign(m_parent.size(), false);
+    for (const Run &p : m_prev)
+    {
+        int root = find(p.m_label);
+        if (!m_touched[root])
+        {
+            done.push_back(toBlob(m_stats[root]));
+            m_touched[root] = true;
+        }
+    }
+    m_prev.clear();
+    m_stats.clear();
+    m_parent.clear();
+}
+
+BlobData BlobScanner::background() const
+{
+    return toBlob(m_background);
 }
@@ -4,6 +4,9 @@
 
 #include "typedefs.h"
 
+// TODO : update this
+#define COUNTFOR_BACKGROUND 0
+
 class BlobData
 {
     cv::Rect    m_rect;
@@ -23,6 +26,7 @@ public:
     inline float fullness() const { return (float)m_area / (m_rect.width * m_rect.height); }
 };
 
+// rows are rendered in parallel, imgOutput must already have the size of imgBinary
 void renderBlobs(
         const BinaryImage &imgBinary,
         cv::Mat &imgOutput,
@@ -32,11 +36,107 @@ void renderBlobs(
         const QVector<bool> &bAllowed
         );
 
-void doForAllBlobs(const BinaryImage &imgBinary, cv::Mat imgOutput, std::function<bool(BlobData &&)> func);
+// func is any callable bool(BlobData &&), called once per label (background
+// included while COUNTFOR_BACKGROUND is 0); blobs it accepts are rendered
+// into imgOutput (CV_8UC1 mask, CV_16UC1 labels or CV_8UC3 colors) if given
+template <typename FILTER>
+void doForAllBlobs(const BinaryImage &imgBinary, cv::Mat imgOutput, const FILTER &func)
+{
+    IntMat labels, statsv;
+    DoubleMat centroids;
+    cv::connectedComponentsWithStats(imgBinary, labels, statsv, centroids);
+    int nLabels = statsv.rows;
+    QVector<bool> bAllowed; // array to track if a blob is allowed after the filtering
+    if (!imgOutput.empty())
+    {
+        Q_ASSERT(imgOutput.type() == CV_8UC1 || imgOutput.type() == CV_16UC1 || imgOutput.type() == CV_8UC3);
+        bAllowed.resize(nLabels);
+    }
+    for (int label = COUNTFOR_BACKGROUND; label < nLabels; ++label) // start from 1, 0 is background label
+    {
+        auto *P = statsv.ptr<int>(label);
+        cv::Rect rect{P[cv::CC_STAT_LEFT], P[cv::CC_STAT_TOP], P[cv::CC_STAT_WIDTH], P[cv::CC_STAT_HEIGHT]};
+        bool bFilterResult = func(BlobData(rect, P[cv::CC_STAT_AREA], {centroids(label, 0), centroids(label, 1)}));
+        if (!bAllowed.empty())
+            bAllowed[label] = bFilterResult;
+    }
+    if (!bAllowed.empty())
+        renderBlobs(imgBinary, imgOutput, labels, statsv, centroids, bAllowed);
+}
 
-inline void doForAllBlobs(const BinaryImage &imgBinary, std::function<bool(BlobData &&BD)> func)
+template <typename FILTER>
+inline void doForAllBlobs(const BinaryImage &imgBinary, const FILTER &func)
 {
     doForAllBlobs(imgBinary, cv::Mat(), func);
 }
 
+// Streaming 8-connected components over runs of foreground pixels. Rows are
+// pushed top to bottom and a blob is reported as soon as a row no longer
+// touches it, so no label image is built and memory only depends on the width.
+class BlobScanner
+{
+public:
+    explicit BlobScanner(int cols);
+
+    // appends the blobs completed by this row to done
+    void pushRow(const quint8 *row, std::vector<BlobData> &done);
+    // appends the blobs still open after the last row
+    void finish(std::vector<BlobData> &done);
+    // stats of the background pixels seen so far
+    BlobData background() const;
+
+private:
+    struct Run
+    {
+        int m_begin;    // [begin, end) columns
+        int m_end;
+        int m_label;
+    };
+
+    struct Stats
+    {
+        int     m_minX, m_minY, m_maxX, m_maxY;
+        quint32 m_area;
+        double  m_sumX, m_sumY;
+    };
+
+    int find(int label);
+    void unite(int a, int b);
+    BlobData toBlob(const Stats &stats) const;
+
+    int m_cols;
+    int m_row = 0;
+    std::vector<Run> m_prev, m_cur;
+    std::vector<int> m_parent;          // union-find over the labels of m_prev and m_cur
+    std::vector<Stats> m_stats;
+    std::vector<bool> m_touched;
+    Stats m_background;
+};
+
+// doForAllBlobs without the label image : blobs come out in the order they are
+// completed (background last) and the accepted ones are returned
+template <typename FILTER>
+std::vector<BlobData> filterBlobsStreaming(const BinaryImage &imgBinary, const FILTER &func)
+{
+    BlobScanner scanner(imgBinary.cols);
+    std::vector<BlobData> done, kept;
+    auto filter = [&]()
+    {
+        for (const BlobData &blob : done)
+            if (func(BlobData(blob)))
+                kept.push_back(blob);
+        done.clear();
+    };
+    for (int y = 0; y < imgBinary.rows; ++y)
+    {
+        scanner.pushRow(imgBinary[y], done);
+        filter();
+    }
+    scanner.finish(done);
+    if (COUNTFOR_BACKGROUND == 0)
+        done.push_back(scanner.background());
+    filter();
+    return kept;
+}
+
 #endif // BLOBS_H
@@ -0,0 +1,78 @@
+#ifndef BLOCKINGQUEUE_H
+#define BLOCKINGQUEUE_H
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+
+// Bounded counterpart of BufferQueue for producer / consumer stages :
+// enqueue blocks while the queue is full, dequeue blocks while it is empty.
+// After close() consumers drain what is left and then dequeue returns false.
+template <class T>
+class BlockingQueue
+{
+  public:
+    explicit BlockingQueue(int capacity) : m_capacity(capacity > 0 ? capacity : 1)
+    {
+    }
+
+    inline bool enqueue(T input)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (!m_closed && (int)m_buffer.size() >= m_capacity)
+            m_notFull.wait(&m_mutex);
+        if (m_closed)
+            return false;
+        m_buffer.push_back(std::move(input));
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    inline bool dequeue(T &out)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_buffer.empty() && !m_closed)
+            m_notEmpty.wait(&m_mutex);
+        if (m_buffer.empty())
+            return false;
+        out = std::move(m_buffer.front());
+        m_buffer.pop_front();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    // dequeue that returns false instead of waiting for an element
+    inline bool tryDequeue(T &out)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_buffer.empty())
+            return false;
+        out = std::move(m_buffer.front());
+        m_buffer.pop_front();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    inline void close()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+    inline int size()
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_buffer.size();
+    }
+
+  private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    std::deque<T> m_buffer;
+    int m_capacity;
+    bool m_closed = false;
+};
+
+#endif // BLOCKINGQUEUE_H
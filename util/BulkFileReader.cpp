@@ -0,0 +1,518 @@
+#include "precompiled.h"
+
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "BulkFileReader.h"
+#include "BlockingQueue.h"
+
+// io_uring is used through its raw system calls, no liburing needed
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define CPV_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+namespace
+{
+struct FileBuffer
+{
+    int m_index = -1;
+    std::vector<uchar> m_bytes;
+};
+
+using FileQueue = BlockingQueue<FileBuffer>;
+
+// opens a regular file for reading, -1 on failure
+int openForRead(const QString &path, qint64 &size)
+{
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return -1;
+    }
+    size = st.st_size;
+    return fd;
+}
+
+// reads bytes [done, size) of fd, bytes is cut short if the file shrank and
+// cleared on error
+void preadRest(int fd, std::vector<uchar> &bytes, qint64 done)
+{
+    qint64 size = bytes.size();
+    while (done < size)
+    {
+        ssize_t n = pread(fd, bytes.data() + done, size - done, done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            bytes.clear();
+            return;
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+    bytes.resize(done);
+}
+
+FileBuffer readFile(int index, const QString &path)
+{
+    FileBuffer buf;
+    buf.m_index = index;
+    qint64 size = 0;
+    int fd = openForRead(path, size);
+    if (fd < 0)
+        return buf;
+    buf.m_bytes.resize(size);
+    preadRest(fd, buf.m_bytes, 0);
+    ::close(fd);
+    return buf;
+}
+
+// every thread keeps one blocking read in flight
+void readWithThreads(const std::vector<QString> &paths, FileQueue &queue, int nThreads)
+{
+    std::atomic<int> next(0);
+    int nFiles = paths.size();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t)
+        threads.emplace_back([&]()
+        {
+            int i;
+            while ((i = next++) < nFiles)
+                queue.enqueue(readFile(i, paths[i]));
+        });
+    for (auto &thread : threads)
+        thread.join();
+}
+
+#ifdef CPV_HAVE_IO_URING
+// the submission and completion rings of one io_uring instance
+class URing
+{
+  public:
+    ~URing()
+    {
+        if (m_sqes != MAP_FAILED)
+            munmap(m_sqes, m_sqesSize);
+        if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+            munmap(m_cqRing, m_cqRingSize);
+        if (m_sqRing != MAP_FAILED)
+            munmap(m_sqRing, m_sqRingSize);
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    bool init(unsigned entries)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        m_fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (m_fd < 0)
+            return false;
+        m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+        singleMmap = p.features & IORING_FEAT_SINGLE_MMAP;
+#endif
+        if (singleMmap)
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED)
+            return false;
+        m_cqRing = singleMmap ? m_sqRing
+                   : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED)
+            return false;
+        m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (m_sqes == MAP_FAILED)
+            return false;
+        char *sq = (char *)m_sqRing;
+        m_sqHead = (unsigned *)(sq + p.sq_off.head);
+        m_sqTail = (unsigned *)(sq + p.sq_off.tail);
+        m_sqMask = *(unsigned *)(sq + p.sq_off.ring_mask);
+        m_sqArray = (unsigned *)(sq + p.sq_off.array);
+        m_sqEntries = p.sq_entries;
+        char *cq = (char *)m_cqRing;
+        m_cqHead = (unsigned *)(cq + p.cq_off.head);
+        m_cqTail = (unsigned *)(cq + p.cq_off.tail);
+        m_cqMask = *(unsigned *)(cq + p.cq_off.ring_mask);
+        m_cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+        m_localTail = *m_sqTail;
+        return true;
+    }
+
+    inline unsigned entries() const
+    {
+        return m_sqEntries;
+    }
+
+    // zeroed submission entry, nullptr while the ring is full
+    io_uring_sqe *nextSqe()
+    {
+        unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_localTail - head >= m_sqEntries)
+            return nullptr;
+        unsigned slot = m_localTail & m_sqMask;
+        io_uring_sqe *sqe = &m_sqes[slot];
+        memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[slot] = slot;
+        ++m_localTail;
+        return sqe;
+    }
+
+    // hands the queued entries to the kernel and waits for waitNr completions
+    bool submit(unsigned waitNr)
+    {
+        __atomic_store_n(m_sqTail, m_localTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = m_localTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        while (true)
+        {
+            int ret = syscall(__NR_io_uring_enter, m_fd, toSubmit, waitNr,
+                              waitNr ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (ret >= 0)
+                return true;
+            if (errno != EINTR)
+                return false;
+            toSubmit = m_localTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    // takes back the queued entries the kernel has not consumed and returns
+    // their user_data. Without SQPOLL the kernel only reads the ring inside
+    // io_uring_enter, so moving the tail back is safe between calls
+    std::vector<quint64> withdraw()
+    {
+        unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        std::vector<quint64> taken;
+        for (unsigned k = head; k != m_localTail; ++k)
+            taken.push_back(m_sqes[m_sqArray[k & m_sqMask]].user_data);
+        m_localTail = head;
+        __atomic_store_n(m_sqTail, head, __ATOMIC_RELEASE);
+        return taken;
+    }
+
+    io_uring_cqe *peekCqe()
+    {
+        unsigned head = *m_cqHead;
+        if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+            return nullptr;
+        return &m_cqes[head & m_cqMask];
+    }
+
+    void popCqe()
+    {
+        __atomic_store_n(m_cqHead, *m_cqHead + 1, __ATOMIC_RELEASE);
+    }
+
+  private:
+    int m_fd = -1;
+    void *m_sqRing = MAP_FAILED;
+    void *m_cqRing = MAP_FAILED;
+    io_uring_sqe *m_sqes = (io_uring_sqe *)MAP_FAILED;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    size_t m_sqesSize = 0;
+    unsigned *m_sqHead = nullptr;
+    unsigned *m_sqTail = nullptr;
+    unsigned *m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+    unsigned m_localTail = 0;
+};
+
+// one file being read through the ring
+struct ReadSlot
+{
+    int m_index;
+    int m_fd;
+    qint64 m_done;
+    iovec m_iov;
+    std::vector<uchar> m_bytes;
+};
+
+// a file opened ahead of its read
+struct OpenedFile
+{
+    int m_index = -1;
+    int m_fd = -1;
+    qint64 m_size = 0;
+};
+
+// open and fstat block with nothing to wait on through the ring, on a network
+// file system each is a round trip, so a few threads run them ahead of the
+// reads and hand the descriptors over
+static const int MAX_OPENERS = 16;
+
+// keeps up to depth reads in flight on a single thread, false if no ring
+// could be set up, nothing has been read then
+bool readWithUring(const std::vector<QString> &paths, FileQueue &queue, int depth)
+{
+    URing ring;
+    if (!ring.init(depth))
+        return false;
+    depth = std::min<int>(depth, ring.entries());
+    std::vector<ReadSlot> slots(depth);
+    std::vector<int> freeSlots;
+    for (int s = depth - 1; s >= 0; --s)
+        freeSlots.push_back(s);
+
+    int nFiles = paths.size();
+    BlockingQueue<OpenedFile> opened(depth);
+    std::atomic<int> next(0);
+    int nOpeners = std::max(1, std::min(std::min(depth, MAX_OPENERS), nFiles));
+    std::atomic<int> openersLeft(nOpeners);
+    std::vector<std::thread> openers;
+    for (int t = 0; t < nOpeners; ++t)
+        openers.emplace_back([&]()
+        {
+            int i;
+            while ((i = next++) < nFiles)
+            {
+                OpenedFile file;
+                file.m_index = i;
+                file.m_fd = openForRead(paths[i], file.m_size);
+                if (file.m_fd < 0 || file.m_size == 0)
+                {
+                    if (file.m_fd >= 0)
+                        ::close(file.m_fd);
+                    FileBuffer failed;
+                    failed.m_index = i;
+                    queue.enqueue(std::move(failed));
+                    continue;
+                }
+                opened.enqueue(file);
+            }
+            if (--openersLeft == 0)
+                opened.close();
+        });
+
+    // a failing ring is not expected once set up, the files still pending
+    // are then finished with plain preads
+    bool ringBroken = false;
+    // slots whose read has to be finished with pread once the ring broke
+    std::vector<int> retry;
+    int inFlight = 0;
+    auto queueRead = [&](int s)
+    {
+        ReadSlot &slot = slots[s];
+        io_uring_sqe *sqe = ring.nextSqe();
+        slot.m_iov.iov_base = slot.m_bytes.data() + slot.m_done;
+        slot.m_iov.iov_len = slot.m_bytes.size() - slot.m_done;
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = slot.m_fd;
+        sqe->addr = (quint64)&slot.m_iov;
+        sqe->len = 1;
+        sqe->off = slot.m_done;
+        sqe->user_data = s;
+    };
+    auto finish = [&](int s)
+    {
+        ReadSlot &slot = slots[s];
+        ::close(slot.m_fd);
+        FileBuffer buf;
+        buf.m_index = slot.m_index;
+        buf.m_bytes = std::move(slot.m_bytes);
+        freeSlots.push_back(s);
+        queue.enqueue(std::move(buf));
+    };
+    auto reap = [&]()
+    {
+        while (io_uring_cqe *cqe = ring.peekCqe())
+        {
+            int s = cqe->user_data;
+            int res = cqe->res;
+            ring.popCqe();
+            ReadSlot &slot = slots[s];
+            if (res > 0)
+                slot.m_done += res;
+            // interrupted or short read, ask for the rest
+            bool more = res == -EINTR || res == -EAGAIN
+                        || (res > 0 && slot.m_done < (qint64)slot.m_bytes.size());
+            if (more && !ringBroken)
+            {
+                queueRead(s);
+                continue;
+            }
+            --inFlight;
+            if (more)
+            {
+                retry.push_back(s);
+                continue;
+            }
+            if (res < 0)
+                slot.m_bytes.clear();
+            else if (res == 0)
+                slot.m_bytes.resize(slot.m_done);
+            finish(s);
+        }
+    };
+
+    bool openersDone = false;
+    while (!ringBroken && (!openersDone || inFlight > 0))
+    {
+        // only wait for the openers while nothing is in flight
+        while (!openersDone && !freeSlots.empty())
+        {
+            OpenedFile file;
+            if (inFlight > 0)
+            {
+                if (!opened.tryDequeue(file))
+                    break;
+            }
+            else if (!opened.dequeue(file))
+            {
+                openersDone = true;
+                break;
+            }
+            int s = freeSlots.back();
+            freeSlots.pop_back();
+            ReadSlot &slot = slots[s];
+            slot.m_index = file.m_index;
+            slot.m_fd = file.m_fd;
+            slot.m_done = 0;
+            slot.m_bytes.resize(file.m_size);
+            queueRead(s);
+            ++inFlight;
+        }
+        if (inFlight == 0)
+            continue;
+        if (ring.submit(1))
+        {
+            reap();
+            continue;
+        }
+        qWarning() << "ERROR : io_uring_enter failed, falling back to pread";
+        ringBroken = true;
+        // what the kernel never consumed is ours again, what it did consume
+        // stays its own until the completion arrives
+        for (quint64 s : ring.withdraw())
+        {
+            retry.push_back(s);
+            --inFlight;
+        }
+        while (inFlight > 0 && ring.submit(1))
+            reap();
+        for (int s : retry)
+        {
+            preadRest(slots[s].m_fd, slots[s].m_bytes, slots[s].m_done);
+            finish(s);
+        }
+        if (inFlight > 0)
+        {
+            // the kernel may still write into these buffers : the files are
+            // read again into fresh ones and the slots are leaked, fds and all
+            for (int s = 0; s < depth; ++s)
+                if (std::find(freeSlots.begin(), freeSlots.end(), s) == freeSlots.end())
+                    queue.enqueue(readFile(slots[s].m_index, paths[slots[s].m_index]));
+            new std::vector<ReadSlot>(std::move(slots));
+        }
+    }
+    // ring broken : the files opened meanwhile are read on this thread
+    OpenedFile file;
+    while (opened.dequeue(file))
+    {
+        FileBuffer buf;
+        buf.m_index = file.m_index;
+        buf.m_bytes.resize(file.m_size);
+        preadRest(file.m_fd, buf.m_bytes, 0);
+        ::close(file.m_fd);
+        queue.enqueue(std::move(buf));
+    }
+    for (auto &opener : openers)
+        opener.join();
+    return true;
+}
+#endif
+}
+
+BulkFileReader::BulkFileReader(int queueDepth, int nDecoders)
+    : m_queueDepth(queueDepth > 0 ? queueDepth : 1),
+      m_nDecoders(nDecoders > 0 ? nDecoders : QThread::idealThreadCount())
+{
+}
+
+bool BulkFileReader::hasUring()
+{
+#ifdef CPV_HAVE_IO_URING
+    static const bool available = []()
+    {
+        URing ring;
+        return ring.init(2);
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+int BulkFileReader::read(const std::vector<QString> &paths,
+                         const std::function<void(int, std::vector<uchar> &)> &consume) const
+{
+    FileQueue queue(m_queueDepth);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> decoders;
+    for (int t = 0; t < m_nDecoders; ++t)
+        decoders.emplace_back([&]()
+        {
+            FileBuffer buf;
+            while (queue.dequeue(buf))
+            {
+                if (buf.m_bytes.empty())
+                    ++failures;
+                consume(buf.m_index, buf.m_bytes);
+            }
+        });
+    bool done = false;
+#ifdef CPV_HAVE_IO_URING
+    done = readWithUring(paths, queue, m_queueDepth);
+#endif
+    if (!done)
+        readWithThreads(paths, queue, m_queueDepth);
+    queue.close();
+    for (auto &decoder : decoders)
+        decoder.join();
+    return failures;
+}
+
+int BulkFileReader::decode(const std::vector<QString> &paths, std::vector<cv::Mat> &images,
+                           int flags) const
+{
+    images.assign(paths.size(), cv::Mat());
+    std::atomic<int> failures(0);
+    read(paths, [&](int i, std::vector<uchar> &bytes)
+    {
+        if (!bytes.empty())
+            images[i] = cv::imdecode(bytes, flags);
+        if (images[i].empty())
+            ++failures;
+    });
+    return failures;
+}
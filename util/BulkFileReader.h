@@ -0,0 +1,42 @@
+#ifndef CPV_BULK_FILE_READER
+#define CPV_BULK_FILE_READER
+
+#include <opencv2/core.hpp>
+#include <QString>
+#include <functional>
+#include <vector>
+
+// Reads many small files with a deep I/O queue and hands the raw bytes to
+// decoder threads. On Linux the reads go through an io_uring with up to
+// queueDepth requests in flight while a few threads open the files ahead of
+// it; where io_uring is missing or not permitted a pool of pread threads
+// takes its place. Decoders are fed through a
+// bounded queue, so a slow consumer holds back the reads instead of
+// buffering the whole data set.
+class BulkFileReader
+{
+  public:
+    static const int DEFAULT_QUEUE_DEPTH = 64;
+
+    // nDecoders <= 0 : QThread::idealThreadCount()
+    explicit BulkFileReader(int queueDepth = DEFAULT_QUEUE_DEPTH, int nDecoders = 0);
+
+    // calls consume(i, bytes of paths[i]) once per file from the decoder
+    // threads, in no particular order; bytes is empty when the file could
+    // not be read. Returns the number of files that could not be read.
+    int read(const std::vector<QString> &paths,
+             const std::function<void(int, std::vector<uchar> &)> &consume) const;
+    // read followed by cv::imdecode into images[i], images is resized to
+    // paths.size(). Returns the number of files that could not be decoded.
+    int decode(const std::vector<QString> &paths, std::vector<cv::Mat> &images,
+               int flags = cv::IMREAD_GRAYSCALE) const;
+
+    // whether this kernel lets us set up an io_uring
+    static bool hasUring();
+
+  private:
+    int m_queueDepth;
+    int m_nDecoders;
+};
+
+#endif
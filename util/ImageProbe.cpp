@@ -0,0 +1,168 @@
+#include "precompiled.h"
+
+#include <iostream>
+
+#include "ImageProbe.h"
+
+// bumped whenever the cache layout changes
+static const quint32 CACHE_VERSION = 1;
+
+static inline int readBigEndian16(const uchar *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline qint64 readBigEndian32(const uchar *p)
+{
+    return ((qint64)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static bool readJpegSize(QFile &file, int &width, int &height)
+{
+    uchar buf[8];
+    // after SOI : segments of 0xFF marker [length]
+    while (file.read((char *)buf, 2) == 2)
+    {
+        if (buf[0] != 0xFF)
+            return false;
+        uchar marker = buf[1];
+        // fill bytes
+        while (marker == 0xFF)
+        {
+            if (!file.getChar((char *)&marker))
+                return false;
+        }
+        // standalone markers carry no length
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            continue;
+        // start of scan or end of image before any frame header
+        if (marker == 0xDA || marker == 0xD9)
+            return false;
+        if (file.read((char *)buf, 2) != 2)
+            return false;
+        int length = readBigEndian16(buf);
+        if (length < 2)
+            return false;
+        // SOF0-SOF15 except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            // precision, height, width
+            if (file.read((char *)buf, 5) != 5)
+                return false;
+            height = readBigEndian16(buf + 1);
+            width = readBigEndian16(buf + 3);
+            return width > 0 && height > 0;
+        }
+        if (!file.seek(file.pos() + length - 2))
+            return false;
+    }
+    return false;
+}
+
+bool ImageProbe::readHeaderSize(const QString &path, int &width, int &height)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    uchar head[24];
+    qint64 n = file.read((char *)head, 24);
+    if (n >= 2 && head[0] == 0xFF && head[1] == 0xD8)
+    {
+        file.seek(2);
+        return readJpegSize(file, width, height);
+    }
+    static const uchar pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (n == 24 && std::equal(pngSignature, pngSignature + 8, head)
+            && std::equal(head + 12, head + 16, (const uchar *)"IHDR"))
+    {
+        width = (int)readBigEndian32(head + 16);
+        height = (int)readBigEndian32(head + 20);
+        return width > 0 && height > 0;
+    }
+    return false;
+}
+
+ImageProbe::ImageProbe(const QString &cacheFile) : m_cacheFile(cacheFile)
+{
+    if (m_cacheFile.isEmpty())
+        return;
+    QFile input(m_cacheFile);
+    if (!input.open(QIODevice::ReadOnly))
+        return;
+    QDataStream in(&input);
+    quint32 version;
+    qint32 count;
+    in >> version >> count;
+    if (version != CACHE_VERSION)
+        return;
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        QString path;
+        Entry entry;
+        in >> path >> entry.m_mtime >> entry.m_size >> entry.m_width >> entry.m_height;
+        m_cache.insert(path, entry);
+    }
+}
+
+bool ImageProbe::imageSize(const QString &path, int &width, int &height)
+{
+    QFileInfo info(path);
+    qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    qint64 size = info.size();
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_cache.constFind(path);
+        if (it != m_cache.constEnd() && it->m_mtime == mtime && it->m_size == size)
+        {
+            width = it->m_width;
+            height = it->m_height;
+            return true;
+        }
+    }
+    if (!readHeaderSize(path, width, height))
+    {
+        // unusual headers are decoded once, the cache keeps the result
+        cv::Mat img = cv::imread(path.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
+        if (img.empty())
+        {
+            qWarning() << "ERROR : " << path << " can not be read!";
+            return false;
+        }
+        width = img.cols;
+        height = img.rows;
+    }
+    QMutexLocker locker(&m_mutex);
+    m_cache.insert(path, {mtime, size, width, height});
+    m_dirty = true;
+    return true;
+}
+
+QString ImageProbe::cacheFileFor(const QString &dir)
+{
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QString root = QFileInfo(dir).absoluteFilePath();
+    QByteArray key = QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return cacheDir + "/imagesizes/" + key + ".bin";
+}
+
+bool ImageProbe::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty || m_cacheFile.isEmpty())
+        return true;
+    QDir().mkpath(QFileInfo(m_cacheFile).absolutePath());
+    QSaveFile output(m_cacheFile);
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        std::cout << "ImageProbe::save failed to open file! \n";
+        return false;
+    }
+    QDataStream out(&output);
+    out << CACHE_VERSION << (qint32)m_cache.size();
+    for (auto it = m_cache.constBegin(); it != m_cache.constEnd(); ++it)
+        out << it.key() << it->m_mtime << it->m_size << it->m_width << it->m_height;
+    if (!output.commit())
+        return false;
+    m_dirty = false;
+    return true;
+}
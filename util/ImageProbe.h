@@ -0,0 +1,43 @@
+#ifndef CPV_IMAGE_PROBE
+#define CPV_IMAGE_PROBE
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// Image dimensions without decoding : JPEG SOFn and PNG IHDR headers are read
+// directly, anything else falls back to cv::imread. Results are cached per file
+// and reused while the file's size and modification time are unchanged.
+class ImageProbe
+{
+  public:
+    // cacheFile may be empty for an in-memory cache only
+    explicit ImageProbe(const QString &cacheFile = QString());
+
+    // thread safe
+    bool imageSize(const QString &path, int &width, int &height);
+    // writes the cache back if it changed
+    bool save();
+
+    // cache file for the images under dir, kept in the user's cache directory
+    // so read only or shared data sets are never written to
+    static QString cacheFileFor(const QString &dir);
+    // parses the header of a JPEG or PNG file
+    static bool readHeaderSize(const QString &path, int &width, int &height);
+
+  private:
+    struct Entry
+    {
+        qint64 m_mtime;
+        qint64 m_size;
+        int m_width;
+        int m_height;
+    };
+
+    QString m_cacheFile;
+    QHash<QString, Entry> m_cache;
+    QMutex m_mutex;
+    bool m_dirty = false;
+};
+
+#endif
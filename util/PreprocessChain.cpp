@@ -0,0 +1,237 @@
+#include "precompiled.h"
+
+#include <atomic>
+#include <cfloat>
+
+#include "PreprocessChain.h"
+#include "BulkFileReader.h"
+
+PreprocessChain &PreprocessChain::otsu()
+{
+    m_steps.push_back({PreprocessOp::Otsu, 0, 0});
+    return *this;
+}
+
+PreprocessChain &PreprocessChain::threshold(int level)
+{
+    m_steps.push_back({PreprocessOp::Threshold, level, 0});
+    return *this;
+}
+
+PreprocessChain &PreprocessChain::invert()
+{
+    m_steps.push_back({PreprocessOp::Invert, 0, 0});
+    return *this;
+}
+
+PreprocessChain &PreprocessChain::blur(int ksize)
+{
+    m_steps.push_back({PreprocessOp::Blur, ksize, ksize});
+    return *this;
+}
+
+PreprocessChain &PreprocessChain::resize(int width, int height)
+{
+    m_steps.push_back({PreprocessOp::Resize, width, height});
+    return *this;
+}
+
+PreprocessChain &PreprocessChain::pad(int x, int y)
+{
+    m_steps.push_back({PreprocessOp::Pad, x, y});
+    return *this;
+}
+
+bool PreprocessChain::parse(const QString &spec, PreprocessChain &chain)
+{
+    for (const QString &token : spec.split(',', QString::SkipEmptyParts))
+    {
+        QStringList parts = token.trimmed().split(':');
+        QString name = parts[0].toLower();
+        QStringList args = parts.size() > 1 ? parts[1].split('x') : QStringList();
+        int a = args.size() > 0 ? args[0].toInt() : 0;
+        int b = args.size() > 1 ? args[1].toInt() : a;
+        if (name == "otsu")
+            chain.otsu();
+        else if (name == "invert")
+            chain.invert();
+        else if (name == "threshold" && args.size() == 1)
+            chain.threshold(a);
+        else if (name == "blur" && a > 0)
+            chain.blur(a);
+        else if (name == "resize" && args.size() == 2)
+            chain.resize(a, b);
+        else if (name == "pad" && !args.isEmpty())
+            chain.pad(a, b);
+        else
+        {
+            qWarning() << "ERROR : unknown preprocessing step " << token;
+            return false;
+        }
+    }
+    return true;
+}
+
+int PreprocessChain::otsuLevel(const double hist[256], double total)
+{
+    double scale = 1. / total;
+    double mu = 0;
+    for (int i = 0; i < 256; ++i)
+        mu += i * hist[i];
+    mu *= scale;
+    double mu1 = 0, q1 = 0;
+    double max_sigma = 0, max_val = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+        double p_i = hist[i] * scale;
+        mu1 *= q1;
+        q1 += p_i;
+        double q2 = 1. - q1;
+        if (std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1. - FLT_EPSILON)
+            continue;
+        mu1 = (mu1 + i * p_i) / q1;
+        double mu2 = (mu - q1 * mu1) / q2;
+        double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+        if (sigma > max_sigma)
+        {
+            max_sigma = sigma;
+            max_val = i;
+        }
+    }
+    return (int)max_val;
+}
+
+cv::Mat PreprocessChain::apply(const cv::Mat &gray) const
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    cv::Mat img = gray;
+    bool owned = false;     // img is ours to overwrite
+    size_t i = 0;
+    while (i < m_steps.size())
+    {
+        const PreprocessStep &step = m_steps[i];
+        if (step.m_op == PreprocessOp::Otsu || step.m_op == PreprocessOp::Threshold
+                || step.m_op == PreprocessOp::Invert)
+        {
+            // fold the run of point-wise steps into one table
+            quint8 lut[256];
+            for (int v = 0; v < 256; ++v)
+                lut[v] = v;
+            double rawHist[256];
+            bool hasHist = false;
+            for (; i < m_steps.size(); ++i)
+            {
+                const PreprocessStep &p = m_steps[i];
+                if (p.m_op == PreprocessOp::Invert)
+                {
+                    for (int v = 0; v < 256; ++v)
+                        lut[v] = 255 - lut[v];
+                }
+                else if (p.m_op == PreprocessOp::Threshold || p.m_op == PreprocessOp::Otsu)
+                {
+                    int level = p.m_a;
+                    if (p.m_op == PreprocessOp::Otsu)
+                    {
+                        if (!hasHist)
+                        {
+                            std::fill(rawHist, rawHist + 256, 0.0);
+                            for (int r = 0; r < img.rows; ++r)
+                            {
+                                const quint8 *pRow = img.ptr<quint8>(r);
+                                for (int c = 0; c < img.cols; ++c)
+                                    ++rawHist[pRow[c]];
+                            }
+                            hasHist = true;
+                        }
+                        // histogram of the image the previous steps would produce
+                        double hist[256] = {0};
+                        for (int v = 0; v < 256; ++v)
+                            hist[lut[v]] += rawHist[v];
+                        level = otsuLevel(hist, img.total());
+                    }
+                    for (int v = 0; v < 256; ++v)
+                        lut[v] = lut[v] > level ? 255 : 0;
+                }
+                else
+                    break;
+            }
+            cv::Mat table(1, 256, CV_8U, lut);
+            cv::Mat out;
+            cv::LUT(img, table, owned ? img : out);
+            if (!owned)
+                img = out;
+            owned = true;
+            continue;
+        }
+        cv::Mat out;
+        if (step.m_op == PreprocessOp::Blur)
+            cv::blur(img, out, cv::Size(step.m_a, step.m_b));
+        else if (step.m_op == PreprocessOp::Resize)
+        {
+            cv::Size size(step.m_a > 0 ? step.m_a : img.cols, step.m_b > 0 ? step.m_b : img.rows);
+            if (size == img.size())
+                out = img;
+            else
+                cv::resize(img, out, size);
+        }
+        else if (step.m_op == PreprocessOp::Pad)
+            cv::copyMakeBorder(img, out, step.m_b, step.m_b, step.m_a, step.m_a,
+                               cv::BORDER_CONSTANT, cv::Scalar(0));
+        owned = owned || out.data != img.data;
+        img = out;
+        ++i;
+    }
+    return owned ? img : img.clone();
+}
+
+int PreprocessChain::run(const QString &srcDir, const QString &outDir, int nThreads) const
+{
+    // list the images and create the output folders up front
+    QStringList files;
+    QDirIterator ittDir(srcDir, QDir::Dirs | QDir::NoDotAndDotDot | QDir::CaseSensitive);
+    while (ittDir.hasNext())
+    {
+        ittDir.next();
+        QString folder = ittDir.fileName();
+        QDir dir_save(outDir + "/" + folder);
+        if (!dir_save.exists())
+        {
+            dir_save.mkpath(".");
+            if (!dir_save.exists())
+            {
+                qWarning() << "ERROR : " << dir_save << " can not be created!";
+                continue;
+            }
+        }
+        QDirIterator ittFile(srcDir + "/" + folder,
+                             QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files);
+        while (ittFile.hasNext())
+        {
+            ittFile.next();
+            files << folder + "/" + ittFile.fileName();
+        }
+    }
+    std::vector<QString> paths;
+    paths.reserve(files.size());
+    for (const QString &file : files)
+        paths.push_back(srcDir + "/" + file);
+    std::atomic<int> written(0);
+    BulkFileReader reader(BulkFileReader::DEFAULT_QUEUE_DEPTH, nThreads);
+    reader.read(paths, [&](int f, std::vector<uchar> &bytes)
+    {
+        cv::Mat img;
+        if (!bytes.empty())
+            img = cv::imdecode(bytes, CV_LOAD_IMAGE_GRAYSCALE);
+        if (img.empty())
+        {
+            qWarning() << "ERROR : " << files[f] << " can not be read!";
+            return;
+        }
+        QString fnameToSave = outDir + "/" + files[f];
+        if (cv::imwrite(fnameToSave.toStdString(), apply(img)))
+            ++written;
+        else
+            qWarning() << "ERROR : " << fnameToSave << " can not be saved!";
+    });
+    return written;
+}
@@ -0,0 +1,63 @@
+#ifndef CPV_PREPROCESS_CHAIN
+#define CPV_PREPROCESS_CHAIN
+
+#include <opencv2/core.hpp>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+enum class PreprocessOp
+{
+    Otsu,           // binary threshold at the Otsu level
+    Threshold,      // binary threshold at m_a
+    Invert,         // 255 - v
+    Blur,           // box blur, m_a x m_a
+    Resize,         // to m_a x m_b, 0 keeps that side of the image
+    Pad             // m_a columns left and right, m_b rows top and bottom
+};
+
+struct PreprocessStep
+{
+    PreprocessOp m_op;
+    int m_a;
+    int m_b;
+};
+
+// Declared chain of grayscale preprocessing operations. Consecutive point-wise
+// steps (otsu, threshold, invert) are fused into a single 256 entry lookup
+// table applied in one pass; otsu takes its level from the input histogram
+// mapped through the table built so far, so no intermediate image is needed.
+// Batches are processed file by file on an OpenMP team, each thread holding
+// only the image it works on.
+class PreprocessChain
+{
+  public:
+    PreprocessChain &otsu();
+    PreprocessChain &threshold(int level);
+    PreprocessChain &invert();
+    PreprocessChain &blur(int ksize);
+    PreprocessChain &resize(int width, int height);
+    PreprocessChain &pad(int x, int y);
+
+    // "otsu,invert,blur:5,resize:32x32,pad:4x4,threshold:128"
+    static bool parse(const QString &spec, PreprocessChain &chain);
+
+    inline bool isEmpty() const
+    {
+        return m_steps.empty();
+    }
+
+    // runs the chain on an 8 bit grayscale image
+    cv::Mat apply(const cv::Mat &gray) const;
+    // every srcDir/<folder>/<image> is decoded in grayscale, processed and
+    // written to outDir/<folder>/<image>, returns the number of images written
+    int run(const QString &srcDir, const QString &outDir, int nThreads = 0) const;
+
+    // Otsu level of an 8 bit histogram, as cv::threshold computes it
+    static int otsuLevel(const double hist[256], double total);
+
+  private:
+    std::vector<PreprocessStep> m_steps;
+};
+
+#endif
@@ -3,11 +3,15 @@
 #include <iostream>
 
 #include "Util.h"
+#include "PreprocessChain.h"
+#include "ImageProbe.h"
+#include "ocr/DatasetManifest.h"
 
 #include "omp.h"
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
 
 void openmp_deneme()
 {
@@ -21,11 +25,11 @@ void deneme()
     cv::Mat_<int> B(5, 5);
     A.setTo(0);
     B.setTo(10);
-    doForAllPixels<float>(A, [](float pixval, quint16 i, quint16 j)
+    doForAllPixels<float>(A, [](float pixval, int i, int j)
     {
         return pixval + 1;
     });
-    doForAllPixels<int>(B, [](int pixval, quint16 i, quint16 j)
+    doForAllPixels<int>(B, [](int pixval, int i, int j)
     {
         return pixval * 5;
     });
@@ -107,6 +111,69 @@ QImage Util::toQt(const cv::Mat &src, QImage::Format format)
     return dest;
 }
 
+static void releaseWrappedMat(void *info)
+{
+    delete static_cast<cv::Mat *>(info);
+}
+
+QImage Util::wrapQt(const cv::Mat &src, QImage::Format format)
+{
+    if(src.empty())
+        return QImage();
+    if(src.type() == CV_8UC1)
+        format = QImage::Format_Grayscale8;
+    else if(src.type() == CV_8UC4)
+        format = QImage::Format_RGB32;
+    else if(src.type() != CV_8UC3)
+        return toQt(src, format);
+    // the heap header holds a reference on the pixels until Qt drops the image
+    cv::Mat *owner = new cv::Mat(src);
+    return QImage(owner->data, owner->cols, owner->rows, (int)owner->step, format,
+                  releaseWrappedMat, owner);
+}
+
+// Hands a QImage's pixels to cv::Mat : the QImage is parked in the UMatData,
+// the last Mat referencing the buffer deletes both.
+class QImageMatAllocator : public cv::MatAllocator
+{
+  public:
+    cv::UMatData *allocate(int, const int *, int, void *, size_t *, int,
+                           cv::UMatUsageFlags) const override
+    {
+        return nullptr;
+    }
+    bool allocate(cv::UMatData *, int, cv::UMatUsageFlags) const override
+    {
+        return false;
+    }
+    void deallocate(cv::UMatData *u) const override
+    {
+        if(!u)
+            return;
+        delete static_cast<QImage *>(u->userdata);
+        delete u;
+    }
+};
+
+cv::Mat Util::toCvShared(QImage image, int cv_type)
+{
+    static QImageMatAllocator allocator;
+    if(image.isNull())
+        return cv::Mat();
+    // moved in images are not shared, so bits() does not detach them
+    QImage *owned = new QImage(std::move(image));
+    uchar *data = owned->bits();
+    cv::Mat mat(owned->height(), owned->width(), cv_type, data, owned->bytesPerLine());
+    cv::UMatData *u = new cv::UMatData(&allocator);
+    u->data = u->origdata = data;
+    u->size = (size_t)owned->bytesPerLine() * owned->height();
+    u->userdata = owned;
+    u->currAllocator = &allocator;
+    u->refcount = 1;
+    mat.u = u;
+    return mat;
+}
+
 QString Util::cleanNumberAndPunctuation(QString toClean)
 {
     QString puncs = "!'^+%&/()=?_-{}][{½$#£><@.,:;|\"§*/";
@@ -147,13 +214,6 @@ QString Util::cleanNumberAndPunctuation(QString toClean)
     return toReturn.toLower();
 }
 
-void Util::plot(const cv::Mat &hist, QWidget *parent, const QString title)
-{
-    HistogramDialogGui *histDialog = new HistogramDialogGui(parent);
-    histDialog->show();
-    histDialog->plot(hist, title);
-}
-
 QString Util::fileNameWithoutPath(QString &filePath)
 {
     int posLastDot = filePath.lastIndexOf(".", -1);
@@ -165,86 +225,76 @@ QString Util::fileNameWithoutPath(QString &filePath)
 
 void Util::convertToOSRAndBlur(QString srcDir, QString outDir, int ksize)
 {
-    QString folder;
-    QString file;
     outDir += "_ksize_" + QString::number(ksize);
-    QDirIterator ittDir(srcDir,
-                        QDir::Dirs | QDir::NoDotAndDotDot | QDir::CaseSensitive);
-    while (ittDir.hasNext())
-    {
-        ittDir.next();
-        folder = ittDir.fileName();
-        QDirIterator ittFile(srcDir + "/" + folder,
-                             QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files);
-        QDir dir_save(outDir + "/" + folder);
-        if (!dir_save.exists())
-        {
-            dir_save.mkpath(".");
-            if(!dir_save.exists())
-                qDebug() << "ERROR : " << dir_save << " can not be created!";
-        }
-        while(ittFile.hasNext())
-        {
-            ittFile.next();
-            file = ittFile.fileName();
-            cv::Mat img_bw = cv::imread(srcDir.toStdString() + "/" + folder.toStdString() +
-                                        "/" + file.toStdString(), 0);
-            //TODO : adaptive threshold test :
-            //            int rows = img_bw.rows;
-            //            int blockSize = (rows/3)*2-1;
-            //            cv::adaptiveThreshold(img_bw, img_bw, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, blockSize, 2);
-            cv::threshold(img_bw, img_bw, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
-            img_bw = 255 - img_bw;
-            cv::blur(img_bw, img_bw, cv::Size(ksize, ksize));
-            QImage saveQIM = Util::toQt(img_bw, QImage::Format_RGB888);
-            saveQIM.save(outDir + "/" + folder + "/" + file);
-        }
-    }
+    //TODO : adaptive threshold test :
+    //            int rows = img_bw.rows;
+    //            int blockSize = (rows/3)*2-1;
+    //            cv::adaptiveThreshold(img_bw, img_bw, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, blockSize, 2);
+    // otsu and invert are fused into one table lookup
+    int written = PreprocessChain().otsu().invert().blur(ksize).run(srcDir, outDir);
+    qDebug() << written << " images converted to " << outDir;
 }
 
 void Util::calcWidthHeightStat(QString srcDir)
 {
-    float w_avrg, h_avrg;
-    int count;
     QString folder;
     QString file;
     QDirIterator ittDir(srcDir,
                         QDir::Dirs | QDir::NoDotAndDotDot | QDir::CaseSensitive) ;
-    QFile outLog(srcDir + "/AverageWidthHeight.txt");
-    outLog.open(QIODevice::WriteOnly);
+    // sizes come from the image headers, cached per data set directory
+    ImageProbe probe(ImageProbe::cacheFileFor(srcDir));
+    QStringList folders;
+    QStringList files;
+    std::vector<int> folderOf;
     while (ittDir.hasNext())
     {
         ittDir.next();
         folder = ittDir.fileName();
         QDirIterator ittFile(srcDir + "/" + folder,
                              QStringList() << "*.jpg" << "*.jpeg", QDir::Files);
-        w_avrg = h_avrg = 0;
-        count = 0;
         while(ittFile.hasNext())
         {
             ittFile.next();
             file = ittFile.fileName();
-            cv::Mat img_bw = cv::imread(srcDir.toStdString() + "/" + folder.toStdString() +
-                                        "/" + file.toStdString(), 0);
-            w_avrg += img_bw.cols;
-            h_avrg += img_bw.rows;
-            ++count;
-            img_bw.release();
+            files << srcDir + "/" + folder + "/" + file;
+            folderOf.push_back(folders.size());
         }
-        w_avrg /= count;
-        h_avrg /= count;
-        outLog.write(folder.toStdString().c_str());
+        folders << folder;
+    }
+    int nFiles = files.size();
+    std::vector<int> widths(nFiles, 0), heights(nFiles, 0);
+    std::vector<char> found(nFiles, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < nFiles; ++i)
+        found[i] = probe.imageSize(files[i], widths[i], heights[i]);
+    probe.save();
+
+    int nFolders = folders.size();
+    std::vector<float> w_avrg(nFolders, 0), h_avrg(nFolders, 0);
+    std::vector<int> count(nFolders, 0);
+    for (int i = 0; i < nFiles; ++i)
+    {
+        if (!found[i])
+            continue;
+        w_avrg[folderOf[i]] += widths[i];
+        h_avrg[folderOf[i]] += heights[i];
+        ++count[folderOf[i]];
+    }
+    QFile outLog(srcDir + "/AverageWidthHeight.txt");
+    outLog.open(QIODevice::WriteOnly);
+    for (int f = 0; f < nFolders; ++f)
+    {
+        // folders without images have no average
+        if (count[f] == 0)
+            continue;
+        w_avrg[f] /= count[f];
+        h_avrg[f] /= count[f];
+        outLog.write(folders[f].toStdString().c_str());
         outLog.write(" ");
-        outLog.write(QByteArray::number((int)(w_avrg + 0.5f)));
+        outLog.write(QByteArray::number((int)(w_avrg[f] + 0.5f)));
         outLog.write(" ");
-        outLog.write(QByteArray::number((int)(h_avrg + 0.5f)));
+        outLog.write(QByteArray::number((int)(h_avrg[f] + 0.5f)));
         outLog.write(" \n");
-        //        QFile textFile(srcDir + "/" + folder + "/" + folder + ".txt");
-        //        textFile.open(QIODevice::WriteOnly);
-        //        textFile.write(QByteArray::number(w_avrg));
-        //        textFile.write(" ");
-        //        textFile.write(QByteArray::number(h_avrg));
-        //        textFile.close();
     }
     outLog.close();
 }
@@ -429,8 +479,9 @@ void Util::getWordWithConfidence(cv::Mat_<float> &layeredHist, int nLabel, QStri
 
 int Util::countImagesInDir(QString dir)
 {
+    // one flat listing, not worth a manifest
     int count = 0;
-    QDirIterator it(dir, QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files);
+    QDirIterator it(dir, DatasetManifest::imageFilters(), QDir::Files);
     while(it.hasNext())
     {
         it.next();
@@ -458,26 +509,159 @@ void Util::writeMatToFile(cv::Mat &m, const char *filename)
 
 
 
-    quint16 lastcol = m.cols-1;
-    doForAllPixels<float>(m, [&, lastcol](float pixval, quint16/* i*/, quint16 j)
+    int lastcol = m.cols-1;
+    doForAllPixels<float>(m, [&, lastcol](float pixval, int/* i*/, int j)
     {
         fout << pixval << "\t";
         if(j == lastcol)
-            fout << std::endl;
-    });
+            fout << "\n";
+    }, PixelPolicy::Continuous());
 
     fout.close();
 }
 
+// eps neighborhoods of all points in compressed form : the neighbors of point i
+// are indices[offsets[i] .. offsets[i + 1]). Points are bucketed into eps x eps
+// cells, so only the 3 x 3 cells around a point can hold its neighbors.
+struct EpsNeighborhoods
+{
+    std::vector<int> offsets;
+    std::vector<int> indices;
+
+    inline int size(int i) const
+    {
+        return offsets[i + 1] - offsets[i];
+    }
+};
+
+static EpsNeighborhoods epsNeighborhoods(const std::vector<cv::Point> &points, float eps)
+{
+    int ptTotal = points.size();
+    EpsNeighborhoods result;
+    result.offsets.assign(ptTotal + 1, 0);
+    if(eps <= 0 || ptTotal == 0)
+        return result;
+    std::vector<long long> cellX(ptTotal), cellY(ptTotal);
+    for(int i = 0; i < ptTotal; ++i)
+    {
+        cellX[i] = (long long)std::floor(points[i].x / eps);
+        cellY[i] = (long long)std::floor(points[i].y / eps);
+    }
+    long long minX = *std::min_element(cellX.begin(), cellX.end());
+    long long minY = *std::min_element(cellY.begin(), cellY.end());
+    long long width = *std::max_element(cellX.begin(), cellX.end()) - minX + 1;
+    long long height = *std::max_element(cellY.begin(), cellY.end()) - minY + 1;
+    // cell id -> [begin, end) in order, the points of one cell are contiguous
+    // and in increasing index. A dense table is used while the grid is not much
+    // larger than the point set, sparse grids fall back to a hash map.
+    std::vector<int> order(ptTotal);
+    std::vector<int> cellStart;
+    std::unordered_map<long long, std::pair<int, int> > cells;
+    bool dense = width * height <= 4LL * ptTotal + 1024;
+    auto cellId = [&](long long cx, long long cy)
+    {
+        return (cy - minY) * width + (cx - minX);
+    };
+    if(dense)
+    {
+        // counting sort on the cell id
+        cellStart.assign(width * height + 1, 0);
+        for(int i = 0; i < ptTotal; ++i)
+            ++cellStart[cellId(cellX[i], cellY[i]) + 1];
+        for(size_t c = 1; c < cellStart.size(); ++c)
+            cellStart[c] += cellStart[c - 1];
+        std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+        for(int i = 0; i < ptTotal; ++i)
+            order[fill[cellId(cellX[i], cellY[i])]++] = i;
+    }
+    else
+    {
+        std::vector<std::pair<long long, int> > sorted(ptTotal);
+        for(int i = 0; i < ptTotal; ++i)
+            sorted[i] = std::make_pair(cellId(cellX[i], cellY[i]), i);
+        std::sort(sorted.begin(), sorted.end());
+        cells.reserve(ptTotal);
+        for(int begin = 0, end; begin < ptTotal; begin = end)
+        {
+            for(end = begin; end < ptTotal && sorted[end].first == sorted[begin].first; ++end)
+                order[end] = sorted[end].second;
+            cells.emplace(sorted[begin].first, std::make_pair(begin, end));
+        }
+    }
+    auto cellRange = [&](long long cx, long long cy)
+    {
+        if(cx < minX || cy < minY || cx - minX >= width || cy - minY >= height)
+            return std::make_pair(0, 0);
+        long long id = cellId(cx, cy);
+        if(dense)
+            return std::make_pair(cellStart[id], cellStart[id + 1]);
+        auto cell = cells.find(id);
+        return cell == cells.end() ? std::make_pair(0, 0) : cell->second;
+    };
+    // points in cell order, walking them in that order keeps the 3 x 3 cell
+    // lookups of consecutive points in cache
+    std::vector<cv::Point> cellPoints(ptTotal);
+    std::vector<std::pair<long long, long long> > cellCoords(ptTotal);
+    for(int k = 0; k < ptTotal; ++k)
+    {
+        cellPoints[k] = points[order[k]];
+        cellCoords[k] = std::make_pair(cellX[order[k]], cellY[order[k]]);
+    }
+    const double eps2 = (double)eps * eps;
+    // first pass counts, second pass fills
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for(int pos = 0; pos < ptTotal; ++pos)
+        {
+            int i = order[pos];
+            const cv::Point &pt = cellPoints[pos];
+            int count = 0;
+            // offsets are only final, and indices allocated, in the second pass
+            int *out = pass ? result.indices.data() + result.offsets[i] : nullptr;
+            for(long long dx = -1; dx <= 1; ++dx)
+                for(long long dy = -1; dy <= 1; ++dy)
+                {
+                    std::pair<int, int> range = cellRange(cellCoords[pos].first + dx,
+                                                          cellCoords[pos].second + dy);
+                    for(int k = range.first; k < range.second; ++k)
+                    {
+                        int j = order[k];
+                        double ddx = (double)pt.x - cellPoints[k].x;
+                        double ddy = (double)pt.y - cellPoints[k].y;
+                        double dist2 = ddx * ddx + ddy * ddy;
+                        if(dist2 <= eps2 && dist2 != 0.0)
+                        {
+                            if(pass)
+                                out[count] = j;
+                            ++count;
+                        }
+                    }
+                }
+            if(pass)
+                std::sort(out, out + count);
+            else
+                result.offsets[i + 1] = count;
+        }
+        if(pass == 0)
+        {
+            for(int i = 0; i < ptTotal; ++i)
+                result.offsets[i + 1] += result.offsets[i];
+            result.indices.resize(result.offsets[ptTotal]);
+        }
+    }
+    return result;
+}
+
 std::vector<std::vector<cv::Point> > Util::DBSCAN_points(std::vector<cv::Point> *points, float eps, unsigned int minPts)
 {
     int ptTotal = points->size();
-    int c{};
     std::vector<std::vector<cv::Point> > clusters;
+    EpsNeighborhoods neighborhoods = epsNeighborhoods(*points, eps);
     std::vector<bool> clustered(ptTotal,false);
     std::vector<bool> visited(ptTotal,false);
-    std::vector<int> neighborPts;
-    std::vector<int> neighborPts_;
+    std::vector<bool> queued(ptTotal,false);
+    std::vector<int> seeds;
 
     //for each unvisted point P in dataset points
     for(auto i = 0; i < ptTotal; ++i)
@@ -485,50 +669,52 @@ std::vector<std::vector<cv::Point> > Util::DBSCAN_points(std::vector<cv::Point>
         if(visited[i]) continue; // proceed to the next point
 
         visited[i] = true;
-        neighborPts = regionQuery(points,&points->at(i),eps);
-
-        if(neighborPts.size() < minPts) continue; // it is noise
+        if((unsigned int)neighborhoods.size(i) < minPts) continue; // it is noise
 
         clusters.push_back(std::vector<cv::Point>());
-        clusters[c].push_back(points->at(i));
+        std::vector<cv::Point> &cluster = clusters.back();
+        cluster.push_back(points->at(i));
         clustered[i] = true;
 
-        //for each point P' in neighborPts
-        unsigned int totNeighbors = neighborPts.size();
-        for(unsigned int j = 0; j < totNeighbors; ++j)
+        // breadth first expansion, every point enters the seeds once
+        seeds.clear();
+        queued[i] = true;
+        for(int k = neighborhoods.offsets[i]; k < neighborhoods.offsets[i + 1]; ++k)
+        {
+            int n = neighborhoods.indices[k];
+            if(!queued[n])
+            {
+                queued[n] = true;
+                seeds.push_back(n);
+            }
+        }
+        for(size_t j = 0; j < seeds.size(); ++j)
         {
+            int p = seeds[j];
             //if P' is not visited
-            if(!visited[neighborPts[j]])
+            if(!visited[p])
             {
                 //Mark P' as visited
-                visited[neighborPts[j]] = true;
-                neighborPts_ = regionQuery(points,&points->at(neighborPts[j]),eps);
-                unsigned int totNeighbors_ = neighborPts_.size();
-                if(totNeighbors_ >= minPts) // if true join these two sets
-                {
-                    std::vector<int> difference;
-                    std::set_difference(neighborPts_.begin(), neighborPts_.end(),
-                                   neighborPts.begin(), neighborPts.end(),
-                                   std::inserter(difference, difference.end()));
-                    neighborPts.insert(neighborPts.end(),difference.begin(),difference.end());
-                    totNeighbors = neighborPts.size();
-                }
-//                    for(unsigned int k = 0; k < totNeighbors_; ++k)
-//                        if(std::find(neighborPts.begin(), neighborPts.end(), neighborPts_[k]) == neighborPts.end()){
-//                            neighborPts.push_back(neighborPts_[k]);
-//                            totNeighbors = neighborPts.size();
-//                        }
+                visited[p] = true;
+                if((unsigned int)neighborhoods.size(p) >= minPts) // P' is a core point, join its neighbors
+                    for(int k = neighborhoods.offsets[p]; k < neighborhoods.offsets[p + 1]; ++k)
+                    {
+                        int n = neighborhoods.indices[k];
+                        if(!queued[n])
+                        {
+                            queued[n] = true;
+                            seeds.push_back(n);
+                        }
+                    }
             }
             // if P' is not yet a member of any cluster
             // add P' to cluster c
-            if(!clustered[neighborPts[j]])
+            if(!clustered[p])
             {
-                clusters[c].push_back(points->at(neighborPts[j]));
-                clustered[neighborPts[j]] = true;
+                cluster.push_back(points->at(p));
+                clustered[p] = true;
             }
         }
-
-        c++;
     }
     return clusters;
 }
@@ -1,25 +1,79 @@
 #ifndef CPV_UTIL
 #define CPV_UTIL
 
-#include "ocr/HistogramDialogGui.h"
 #include "rdf/PixelCloud.h"
 
+// Execution policies of doForAllPixels / setForAllPixels, func is always
+// called as func(value, row, col) :
+//  Sequential   : row by row on the calling thread (the default)
+//  ParallelRows : rows are spread over nThreads OpenMP threads (0 = all cores),
+//                 func must be safe to call concurrently for different rows
+//  Continuous   : doForAllPixels walks a continuous matrix as one flat array,
+//                 in order, setForAllPixels lets the compiler vectorize func
+//                 over the columns of each row
+namespace PixelPolicy
+{
+struct Sequential {};
+struct ParallelRows
+{
+    int nThreads = 0;
+};
+struct Continuous {};
+}
+
 template <typename T, typename FUNC>
-void doForAllPixels(const cv::Mat_<T> &M, const FUNC &func)
+void doForAllPixels(const cv::Mat_<T> &M, const FUNC &func, PixelPolicy::Sequential = {})
 {
     int nRows = M.rows;
     int nCols = M.cols;
-    for(quint16 i = 0; i < nRows; ++i)
+    for(int i = 0; i < nRows; ++i)
     {
         auto *pRow = (T *)M.ptr(i);
-        for(quint16 j = 0; j < nCols; ++j, ++pRow)
+        for(int j = 0; j < nCols; ++j, ++pRow)
             func(*pRow, i, j);
     }
 }
 
+template <typename T, typename FUNC>
+void doForAllPixels(const cv::Mat_<T> &M, const FUNC &func, PixelPolicy::ParallelRows policy)
+{
+    int nRows = M.rows;
+    int nCols = M.cols;
+    int nThreads = policy.nThreads > 0 ? policy.nThreads : QThread::idealThreadCount();
+    #pragma omp parallel for schedule(static) num_threads(nThreads)
+    for(int i = 0; i < nRows; ++i)
+    {
+        auto *pRow = (T *)M.ptr(i);
+        for(int j = 0; j < nCols; ++j, ++pRow)
+            func(*pRow, i, j);
+    }
+}
 
 template <typename T, typename FUNC>
-void setForAllPixels(cv::Mat_<T> &M, const FUNC &func)
+void doForAllPixels(const cv::Mat_<T> &M, const FUNC &func, PixelPolicy::Continuous)
+{
+    if(!M.isContinuous())
+    {
+        doForAllPixels(M, func);
+        return;
+    }
+    int nCols = M.cols;
+    auto *pPixel = (T *)M.data;
+    auto *pEnd = pPixel + M.total();
+    for(int i = 0, j = 0; pPixel != pEnd; ++pPixel)
+    {
+        func(*pPixel, i, j);
+        if(++j == nCols)
+        {
+            j = 0;
+            ++i;
+        }
+    }
+}
+
+
+template <typename T, typename FUNC>
+void setForAllPixels(cv::Mat_<T> &M, const FUNC &func, PixelPolicy::Sequential = {})
 {
     int nRows = M.rows;
     int nCols = M.cols;
@@ -31,6 +85,37 @@ void setForAllPixels(cv::Mat_<T> &M, const FUNC &func)
     }
 }
 
+template <typename T, typename FUNC>
+void setForAllPixels(cv::Mat_<T> &M, const FUNC &func, PixelPolicy::ParallelRows policy)
+{
+    int nRows = M.rows;
+    int nCols = M.cols;
+    int nThreads = policy.nThreads > 0 ? policy.nThreads : QThread::idealThreadCount();
+    #pragma omp parallel for schedule(static) num_threads(nThreads)
+    for(int i = 0; i < nRows; ++i)
+    {
+        auto *pRow = (T *)M.ptr(i);
+        for(int j = 0; j < nCols; ++j)
+            pRow[j] = func(pRow[j], i, j);
+    }
+}
+
+template <typename T, typename FUNC>
+void setForAllPixels(cv::Mat_<T> &M, const FUNC &func, PixelPolicy::Continuous)
+{
+    int nRows = M.rows;
+    int nCols = M.cols;
+    // row and column come straight from the loop counters, a division per
+    // pixel to recover them from a flat index would keep the loop scalar
+    for(int i = 0; i < nRows; ++i)
+    {
+        auto *pRow = (T *)M.ptr(i);
+        #pragma omp simd
+        for(int j = 0; j < nCols; ++j)
+            pRow[j] = func(pRow[j], i, j);
+    }
+}
+
 template <typename T>
 inline double sumall(const T &container)
 {
@@ -113,10 +198,10 @@ inline int getMaxLikelihoodIndex(const QVector<float> &hist)
 
 inline void getImageLabelVotes(const cv::Mat_<uchar> &label_image, QVector<float> &vote_vector)
 {
-    doForAllPixels(label_image, [&](uchar value, quint16, quint16)
+    doForAllPixels(label_image, [&](uchar value, int, int)
     {
         ++vote_vector[value];
-    });
+    }, PixelPolicy::Continuous());
     //    int nRows = label_image.rows;
     //    int nCols = label_image.cols;
     //    for (int i = 0; i<nRows ; ++i)
@@ -130,12 +215,12 @@ inline void printHistogram(cv::Mat_<float> &hist)
 {
     QString res = "HIST {";
     int nRows = hist.rows;
-    doForAllPixels(hist, [&](float value, quint16 i, quint16 j)
+    doForAllPixels(hist, [&](float value, int i, int)
     {
         res += " " + QString::number(value);
         if(i != nRows - 1)
             res += "\n";
-    });
+    }, PixelPolicy::Continuous());
     //    int nCols = hist.cols;
     //    int nRows = hist.rows;
     //    for(int i=0; i<nRows; ++i)
@@ -160,30 +245,18 @@ inline cv::Mat unpad(const cv::Mat &img, int probe_x, int probe_y)
 
 class Util
 {
-private:
-    static inline std::vector<int> regionQuery(std::vector<cv::Point> *points, cv::Point *point, float eps)
-    {
-        using namespace std;
-
-        float dist;
-        int ptTotal = points->size();
-        vector<int> retKeys;
-        for(auto i = 0; i < ptTotal; ++i)
-        {
-            dist = sqrt(pow((point->x - points->at(i).x),2)+pow((point->y - points->at(i).y),2));
-            if(dist <= eps && dist != 0.0f)
-                retKeys.push_back(i);
-        }
-        return retKeys;
-    }
 public:
     static void print3DHistogram(cv::Mat &inMat);
     static double calculateAccuracy(const std::vector<QString> &groundtruth, const std::vector<QString> &results);
     static cv::Mat toCv(const QImage &image, int cv_type);
     static void CalculateHistogram(cv::Mat &inputMat, cv::Mat &hist, int histSize);
     static QImage toQt(const cv::Mat &src, QImage::Format format);
+    // zero-copy bridges : the QImage keeps a reference on src's buffer and the
+    // cv::Mat keeps the QImage's pixels alive. wrapQt maps CV_8UC1 to
+    // Format_Grayscale8, CV_8UC4 to Format_RGB32 and CV_8UC3 to format
+    static QImage wrapQt(const cv::Mat &src, QImage::Format format = QImage::Format_RGB888);
+    static cv::Mat toCvShared(QImage image, int cv_type);
     static QString cleanNumberAndPunctuation(QString toClean);
-    static void plot(const cv::Mat &hist, QWidget *parent, const QString title);
     static QString fileNameWithoutPath(QString &filePath);
     static void convertToOSRAndBlur(QString srcDir, QString outDir, int ksize);
     static void calcWidthHeightStat(QString srcDir);
@@ -193,6 +266,8 @@ public:
     static void covert32FCto8UC(cv::Mat &input, cv::Mat &output);
 
     static void writeMatToFile(cv::Mat& m, const char* filename);
+    // neighbors are the other points within eps (coincident points excluded),
+    // found through a uniform grid of eps sized cells
     static std::vector<std::vector<cv::Point> > DBSCAN_points(std::vector<cv::Point> *points, float eps, unsigned int minPts);
 };
 
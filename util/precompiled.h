@@ -3,7 +3,11 @@
 
 #include <QtCore/QtCore>
 #include <QtGui/QtGui>
+// only the widgets executable defines CPV_WITH_WIDGETS, the core library and
+// the command-line driver build without QtWidgets
+#ifdef CPV_WITH_WIDGETS
 #include <QtWidgets/QtWidgets>
+#endif
 #include <QtXml/QtXml>
 
 #include <opencv2/core/core.hpp>